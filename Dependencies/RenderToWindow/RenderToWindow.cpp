@@ -143,50 +143,19 @@ void RenderToWindow::handleMessagesBlocking()
 	}
 }
 
-void RenderToWindow::updateImage(vec4 *image)
+void RenderToWindow::updateImage(vec4 *image, gl::ColorConversion::Encoding encoding)
 {
 	if (rt == nullptr) return;
 
-
-	for (size_t y = 0; y < height; y++)
-		for (size_t x = 0; x < width; x++)
-		{
-			vec4 currentColor = image[y * width + x] * 255.0f;
-			rt->pixel(
-				static_cast<int>(x), 
-				static_cast<int>(y), 
-				makeColor(
-					unsigned char(currentColor.r()), 
-					unsigned char(currentColor.g()), 
-					unsigned char(currentColor.b()), 
-					unsigned char(currentColor.a())
-				)
-			);
-		}
-
+	//the bitmap is bottom up like the image, and its BGRA bytes are what makeColor packs
+	gl::ColorConversion::convert(image, width, height, reinterpret_cast<uint8_t *>(rt->data), { .encoding = encoding });
 	rt->present();
 }
 
-void RenderToWindow::updateImage(float *image)
+void RenderToWindow::updateImage(float *image, gl::ColorConversion::Encoding encoding)
 {
 	if (rt == nullptr) return;
 
-
-	for (size_t y = 0; y < height; y++)
-		for (size_t x = 0; x < width; x++)
-		{
-			float currentColor = image[y * width + x] * 255.0f;
-			rt->pixel(
-				static_cast<int>(x),
-				static_cast<int>(y),
-				makeColor(
-					unsigned char(currentColor),
-					unsigned char(currentColor),
-					unsigned char(currentColor),
-					unsigned char(currentColor)
-				)
-			);
-		}
-
+	gl::ColorConversion::convert(image, width, height, reinterpret_cast<uint8_t *>(rt->data), { .encoding = encoding });
 	rt->present();
 }
\ No newline at end of file
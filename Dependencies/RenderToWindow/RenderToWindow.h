@@ -2,6 +2,7 @@
 #define RENDER_TO_WINDOW_H_DEFINED
 
 #include "vec.h"
+#include "ColorConversion.h"
 #pragma system_header
 
 struct RenderTarget;
@@ -13,8 +14,9 @@ public:
 	~RenderToWindow();
 
 	void handleMessagesBlocking();
-	void updateImage(vec4 *image);
-	void updateImage(float *image);
+	//windows display sRGB, images shaded in linear light have to be encoded to look as they are meant to
+	void updateImage(vec4 *image, gl::ColorConversion::Encoding encoding = gl::ColorConversion::Encoding::Linear);
+	void updateImage(float *image, gl::ColorConversion::Encoding encoding = gl::ColorConversion::Encoding::Linear);
 private:
 
 	size_t width, height;
@@ -18,7 +18,7 @@ public:
 
 	static AABB<N> united(const AABB<N> &firstBox, const AABB<N> &secondBox)
 	{
-		vec2 min = {}, max = {};
+		vec<float, N> min = {}, max = {};
 		for (uint32_t i = 0; i < N; i++)
 		{
 			min[i] = _min(firstBox.min[i], secondBox.min[i]);
@@ -27,6 +27,16 @@ public:
 		return AABB<N>(min, max);
 	}
 
+	AABB<N> &enclose(const vec<float, N> &point)
+	{
+		for (uint32_t i = 0; i < N; i++)
+		{
+			min[i] = _min(min[i], point[i]);
+			max[i] = _max(max[i], point[i]);
+		}
+		return *this;
+	}
+
 	AABB<N> &boundInto(const AABB<N> &other)
 	{
 		min = min.clampedBy(other.min, other.max);
@@ -60,6 +70,11 @@ public:
 		return vec<float, N>::absolute(max - min);
 	}
 
+	vec<float, N> center() const
+	{
+		return (min + max) * .5f;
+	}
+
 	vec<float, N> min;
 	vec<float, N> max;
 };
@@ -1,6 +1,7 @@
 #pragma once
 #include <cstdint>
 #include <fstream>
+#include <stdexcept>
 
 #pragma system_header
 
@@ -80,28 +81,26 @@ namespace bmp
 		bool invertedY = false;
 	};
 
-	void write(const writeInfo info)
+	//file, info and color headers of a bitmap of this size, its pixels directly follow them
+	inline details::BMPHeader makeHeader(uint32_t xPixelCount, uint32_t yPixelCount, bool invertedY = false)
 	{
-		uint32_t headerSize = sizeof(details::BMPFileHeader) + sizeof(details::BMPInfoHeader) + sizeof(details::BMPColorHeader);
-		uint32_t contentsSize = info.xPixelCount * info.yPixelCount * sizeof(bmp::color);
-
-		details::BMPFileHeader fileHeader;
-
-		details::BMPInfoHeader infoHeader;
-		infoHeader.bit_count = sizeof(bmp::color) * 8;
-		infoHeader.width = info.xPixelCount;
-		infoHeader.height = info.yPixelCount;
-		infoHeader.size = sizeof(details::BMPInfoHeader);
-
-		details::BMPColorHeader colorHeader;
+		constexpr uint32_t headerSize = sizeof(details::BMPHeader);
+		const uint32_t contentsSize = xPixelCount * yPixelCount * sizeof(bmp::color);
 
 		details::BMPHeader header;
 		header.fileHeader.file_size = headerSize + contentsSize;
 		header.fileHeader.offset_data = headerSize;
 		header.infoHeader.bit_count = sizeof(bmp::color) * 8;
-		header.infoHeader.width = info.xPixelCount;
-		header.infoHeader.height = info.invertedY ? -(int32_t)info.yPixelCount : (int32_t)info.yPixelCount;
+		header.infoHeader.width = xPixelCount;
+		header.infoHeader.height = invertedY ? -(int32_t)yPixelCount : (int32_t)yPixelCount;
 		header.infoHeader.size = sizeof(details::BMPInfoHeader);
+		return header;
+	}
+
+	inline void write(const writeInfo info)
+	{
+		const details::BMPHeader header = makeHeader(info.xPixelCount, info.yPixelCount, info.invertedY);
+		const uint32_t contentsSize = info.xPixelCount * info.yPixelCount * sizeof(bmp::color);
 
 		std::ofstream file(info.path, std::ios::binary);
 		if (file.fail()) throw std::runtime_error("File open failed!");
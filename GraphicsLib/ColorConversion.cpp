@@ -0,0 +1,231 @@
+#include "ColorConversion.h"
+#include "JobSystem.h"
+#include "Simd.h"
+
+#include <array>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	using ChannelOrder = gl::ColorConversion::ChannelOrder;
+	using Encoding = gl::ColorConversion::Encoding;
+
+	constexpr size_t rowsPerConversionJob = 32;
+
+	//linear values are quantized to this many steps before going through the table
+	//every byte stays reachable, and rounding is at most a byte off the exact encoding
+	constexpr size_t srgbTableSize = 4096;
+
+	const std::array<uint8_t, srgbTableSize> srgbTable = []()
+	{
+		std::array<uint8_t, srgbTableSize> table = {};
+		for (size_t i = 0; i < srgbTableSize; i++)
+		{
+			const float linear = static_cast<float>(i) / static_cast<float>(srgbTableSize - 1);
+			const float encoded = linear <= .0031308f ? linear * 12.92f : 1.055f * std::pow(linear, 1.0f / 2.4f) - .055f;
+			table[i] = static_cast<uint8_t>(encoded * 255.0f + .5f);
+		}
+		return table;
+	}();
+
+	//NaNs end up as 0
+	float saturate(float value)
+	{
+		return value > .0f ? (value < 1.0f ? value : 1.0f) : .0f;
+	}
+
+	uint8_t toLinearByte(float value)
+	{
+		return static_cast<uint8_t>(saturate(value) * 255.0f + .5f);
+	}
+
+	uint8_t encode(float value, Encoding encoding)
+	{
+		if (encoding == Encoding::SRGB)
+		{
+			return srgbTable[static_cast<size_t>(saturate(value) * static_cast<float>(srgbTableSize - 1) + .5f)];
+		}
+		return toLinearByte(value);
+	}
+
+	void store(uint8_t r, uint8_t g, uint8_t b, uint8_t a, uint8_t *out, ChannelOrder order)
+	{
+		switch (order)
+		{
+		case ChannelOrder::RGBA:
+			out[0] = r; out[1] = g; out[2] = b; out[3] = a;
+			break;
+		case ChannelOrder::BGRA:
+			out[0] = b; out[1] = g; out[2] = r; out[3] = a;
+			break;
+		case ChannelOrder::RGB:
+			out[0] = r; out[1] = g; out[2] = b;
+			break;
+		}
+	}
+
+#ifdef SIMD_SSE2
+	//clamped to [0, 1], scaled and rounded to the nearest integer, NaNs end up as 0
+	__m128i quantize(__m128 values, __m128 scale)
+	{
+		const __m128 clamped = _mm_min_ps(_mm_max_ps(values, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+		return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(clamped, scale), _mm_set1_ps(.5f)));
+	}
+
+	//16 bytes of 4 pixels, written as they are or without their alpha
+	void storePixels(__m128i pixels, uint8_t *out, ChannelOrder order)
+	{
+		if (order != ChannelOrder::RGB)
+		{
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(out), pixels);
+			return;
+		}
+
+		alignas(16) uint8_t bytes[16];
+		_mm_store_si128(reinterpret_cast<__m128i *>(bytes), pixels);
+		for (size_t i = 0; i < 4; i++)
+		{
+			std::memcpy(out + i * 3, bytes + i * 4, 3);
+		}
+	}
+#endif
+}
+
+namespace gl
+{
+	void ColorConversion::convert(const vec4 *image, size_t width, size_t height, uint8_t *out, const Info &info)
+	{
+		convertImage(image, width, height, out, info);
+	}
+
+	void ColorConversion::convert(const float *image, size_t width, size_t height, uint8_t *out, const Info &info)
+	{
+		convertImage(image, width, height, out, info);
+	}
+
+	uint8_t ColorConversion::encodeChannel(float value, Encoding encoding)
+	{
+		return encode(value, encoding);
+	}
+
+	template<typename Pixel_t>
+	void ColorConversion::convertImage(const Pixel_t *image, size_t width, size_t height, uint8_t *out, const Info &info)
+	{
+		const size_t rowSize = width * bytesPerPixel(info.order);
+		const auto convertRows = [&](size_t beginRow, size_t endRow)
+		{
+			for (size_t row = beginRow; row < endRow; row++)
+			{
+				const size_t y = info.isTopDown ? height - 1 - row : row;
+				convertRow(image + y * width, width, out + row * rowSize, info);
+			}
+		};
+
+		if (info.isParallel)
+		{
+			JobSystem::parallelFor(height, rowsPerConversionJob, convertRows);
+		}
+		else
+		{
+			convertRows(0, height);
+		}
+	}
+
+	void ColorConversion::convertRow(const vec4 *in, size_t count, uint8_t *out, const Info &info)
+	{
+		static_assert(sizeof(vec4) == 4 * sizeof(float));
+
+		const size_t pixelSize = bytesPerPixel(info.order);
+		size_t i = 0;
+#ifdef SIMD_SSE2
+		const __m128 byteScale = _mm_set1_ps(255.0f);
+		const __m128 tableScale = _mm_set1_ps(static_cast<float>(srgbTableSize - 1));
+		const __m128i alphaMask = _mm_set1_epi32(static_cast<int>(0xff000000));
+		for (; i + 4 <= count; i += 4)
+		{
+			const float *values = reinterpret_cast<const float *>(in + i);
+			__m128 pixels[4];
+			for (size_t k = 0; k < 4; k++)
+			{
+				pixels[k] = _mm_loadu_ps(values + k * 4);
+				if (info.order == ChannelOrder::BGRA)
+				{
+					pixels[k] = _mm_shuffle_ps(pixels[k], pixels[k], _MM_SHUFFLE(3, 0, 1, 2));
+				}
+			}
+
+			__m128i bytes = _mm_packus_epi16(
+				_mm_packs_epi32(quantize(pixels[0], byteScale), quantize(pixels[1], byteScale)),
+				_mm_packs_epi32(quantize(pixels[2], byteScale), quantize(pixels[3], byteScale)));
+
+			if (info.encoding == Encoding::SRGB)
+			{
+				//SSE2 can't gather, the table is read a channel at a time
+				alignas(16) uint8_t encoded[16];
+				alignas(16) int32_t indices[16];
+				_mm_store_si128(reinterpret_cast<__m128i *>(encoded), bytes);
+				for (size_t k = 0; k < 4; k++)
+				{
+					_mm_store_si128(reinterpret_cast<__m128i *>(indices + k * 4), quantize(pixels[k], tableScale));
+					for (size_t channel = 0; channel < 3; channel++)
+					{
+						encoded[k * 4 + channel] = srgbTable[indices[k * 4 + channel]];
+					}
+				}
+				bytes = _mm_load_si128(reinterpret_cast<const __m128i *>(encoded));
+			}
+
+			if (info.isOpaque) bytes = _mm_or_si128(bytes, alphaMask);
+			storePixels(bytes, out + i * pixelSize, info.order);
+		}
+#endif
+		for (; i < count; i++)
+		{
+			const vec4 &color = in[i];
+			const uint8_t alpha = info.isOpaque ? uint8_t(0xff) : toLinearByte(color.a());
+			store(encode(color.r(), info.encoding), encode(color.g(), info.encoding), encode(color.b(), info.encoding), alpha, out + i * pixelSize, info.order);
+		}
+	}
+
+	void ColorConversion::convertRow(const float *in, size_t count, uint8_t *out, const Info &info)
+	{
+		const size_t pixelSize = bytesPerPixel(info.order);
+		size_t i = 0;
+#ifdef SIMD_SSE2
+		const __m128 byteScale = _mm_set1_ps(255.0f);
+		const __m128 tableScale = _mm_set1_ps(static_cast<float>(srgbTableSize - 1));
+		const __m128i alphaMask = _mm_set1_epi32(static_cast<int>(0xff000000));
+		for (; i + 4 <= count; i += 4)
+		{
+			const __m128 values = _mm_loadu_ps(in + i);
+
+			//the 4 pixels' values in the lowest 4 bytes
+			__m128i grays;
+			if (info.encoding == Encoding::SRGB)
+			{
+				alignas(16) int32_t indices[4];
+				_mm_store_si128(reinterpret_cast<__m128i *>(indices), quantize(values, tableScale));
+				grays = _mm_cvtsi32_si128(static_cast<int>(
+					uint32_t(srgbTable[indices[0]]) | uint32_t(srgbTable[indices[1]]) << 8 |
+					uint32_t(srgbTable[indices[2]]) << 16 | uint32_t(srgbTable[indices[3]]) << 24));
+			}
+			else
+			{
+				const __m128i words = _mm_packs_epi32(quantize(values, byteScale), _mm_setzero_si128());
+				grays = _mm_packus_epi16(words, _mm_setzero_si128());
+			}
+
+			//each value repeated over its pixel's 4 bytes
+			const __m128i pairs = _mm_unpacklo_epi8(grays, grays);
+			const __m128i pixels = _mm_or_si128(_mm_unpacklo_epi16(pairs, pairs), alphaMask);
+			storePixels(pixels, out + i * pixelSize, info.order);
+		}
+#endif
+		for (; i < count; i++)
+		{
+			const uint8_t value = encode(in[i], info.encoding);
+			store(value, value, value, 0xff, out + i * pixelSize, info.order);
+		}
+	}
+}
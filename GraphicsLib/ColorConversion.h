@@ -0,0 +1,69 @@
+#pragma once
+#include "vec.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace gl
+{
+	//converts float images to 8 bits per channel, the way windows, image files and videos expect them
+	//values are clamped to [0, 1] and rounded to the nearest byte, four pixels at a time where SSE2 is available
+	class ColorConversion
+	{
+	public:
+
+		enum class ChannelOrder
+		{
+			RGBA,
+			//what bitmaps and windows store
+			BGRA,
+			//without alpha, 3 bytes per pixel
+			RGB
+		};
+
+		enum class Encoding
+		{
+			//values are written as they are
+			Linear,
+			//the color channels go through the sRGB transfer function, alpha stays linear
+			SRGB
+		};
+
+		struct Info
+		{
+			ChannelOrder order = ChannelOrder::BGRA;
+			Encoding encoding = Encoding::Linear;
+			//writes 0xff rather than the image's alpha, grayscale images always are opaque
+			bool isOpaque = true;
+			//images start from the bottom row, top down outputs from the top one
+			bool isTopDown = false;
+			//spreads the rows over the job system rather than converting them all on the calling thread
+			bool isParallel = true;
+		};
+
+		ColorConversion() = delete;
+
+		[[nodiscard]]
+		static constexpr size_t bytesPerPixel(ChannelOrder order)
+		{
+			return order == ChannelOrder::RGB ? 3 : 4;
+		}
+
+		//out has to hold width * height * bytesPerPixel(info.order) bytes
+		static void convert(const vec4 *image, size_t width, size_t height, uint8_t *out, const Info &info);
+		//every color channel gets the pixel's value
+		static void convert(const float *image, size_t width, size_t height, uint8_t *out, const Info &info);
+
+		//a single color channel, as convert writes it, for outputs that aren't made of 8 bit channels
+		[[nodiscard]]
+		static uint8_t encodeChannel(float value, Encoding encoding);
+
+	private:
+
+		template<typename Pixel_t>
+		static void convertImage(const Pixel_t *image, size_t width, size_t height, uint8_t *out, const Info &info);
+
+		static void convertRow(const vec4 *in, size_t count, uint8_t *out, const Info &info);
+		static void convertRow(const float *in, size_t count, uint8_t *out, const Info &info);
+	};
+}
@@ -0,0 +1,201 @@
+#pragma once
+#include "GraphicsLibrary.h"
+
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <limits>
+#include <cassert>
+
+namespace gl
+{
+	enum class DrawKind
+	{
+		//sorted front to back, to get the most out of early depth rejection
+		Opaque,
+		//sorted back to front, after every opaque draw of the same pass
+		Transparent
+	};
+
+	struct SubmitResult
+	{
+		size_t drawn = 0;
+		size_t culled = 0;
+	};
+
+	//records draws, clears and target bindings to execute them later
+	//draws are only reordered between clears and bindings, which act as barriers
+	class CommandBuffer
+	{
+	public:
+
+		template<typename T>
+		void clear(FrameBuffer<T> &target)
+		{
+			//clearing the same target twice in a row does nothing more
+			if (!commands.empty() && commands.back().type == CommandType::Clear && commands.back().target == &target)
+			{
+				return;
+			}
+
+			pushBarrier(CommandType::Clear, &target, [&target]() { target.clear(); });
+		}
+
+		//draws recorded until the next binding are expected to render to these targets
+		template<typename RenderTarget_t>
+		void bindTargets(FrameBuffer<RenderTarget_t> &target, FrameBuffer<float> *depthBuffer = nullptr)
+		{
+			if (boundTarget == &target && boundDepthBuffer == depthBuffer)
+			{
+				return;
+			}
+
+			boundTarget = &target;
+			boundDepthBuffer = depthBuffer;
+			pushBarrier(CommandType::BindTargets, &target, nullptr);
+		}
+
+		//the draw info is copied, whatever its shaders capture by reference has to outlive the submission
+		template<typename RenderTarget_t, Shader Vertex_t, Shader Fragment_t, Attributes Attributes_t>
+		void draw(ModelHandle handle, const DrawInfo<RenderTarget_t, Vertex_t, Fragment_t, Attributes_t> &drawInfo, DrawKind kind = DrawKind::Opaque)
+		{
+			assert(boundTarget == nullptr || (boundTarget == &drawInfo.target && boundDepthBuffer == drawInfo.depthBuffer));
+
+			Command command =
+			{
+				.type = CommandType::Draw,
+				.kind = kind,
+				.pass = pass,
+				.depth = calculateSortDepth(handle, drawInfo.modelViewProjection),
+				.model = static_cast<uint64_t>(handle),
+				.target = &drawInfo.target,
+				.sequence = static_cast<uint32_t>(commands.size()),
+				.draw = [handle, recordedDrawInfo = drawInfo]() mutable { return Rasterizer::drawTriangles(handle, recordedDrawInfo); },
+				.applyBarrier = {}
+			};
+			commands.push_back(std::move(command));
+		}
+
+		//sorts the draws of every pass and executes everything in order, the recorded commands are kept
+		SubmitResult submit()
+		{
+			std::vector<Command *> sorted;
+			sorted.reserve(commands.size());
+			for (Command &command : commands)
+			{
+				sorted.push_back(&command);
+			}
+
+			std::stable_sort(sorted.begin(), sorted.end(), [](const Command *a, const Command *b)
+			{
+				if (a->pass != b->pass) return a->pass < b->pass;
+				//barriers start their pass
+				if (a->type != b->type) return a->type != CommandType::Draw;
+				if (a->type != CommandType::Draw) return a->sequence < b->sequence;
+				if (a->kind != b->kind) return a->kind == DrawKind::Opaque;
+				if (a->depth != b->depth)
+				{
+					return a->kind == DrawKind::Opaque ? a->depth < b->depth : a->depth > b->depth;
+				}
+				//draws of the same model next to each other
+				if (a->model != b->model) return a->model < b->model;
+				return a->sequence < b->sequence;
+			});
+
+			SubmitResult result = {};
+			for (Command *command : sorted)
+			{
+				if (command->type != CommandType::Draw)
+				{
+					if (command->applyBarrier) command->applyBarrier();
+					continue;
+				}
+
+				switch (command->draw())
+				{
+				case DrawResult::Drawn:
+					result.drawn++;
+					break;
+				case DrawResult::Culled:
+					result.culled++;
+					break;
+				default:
+					break;
+				}
+			}
+			return result;
+		}
+
+		void reset()
+		{
+			commands.clear();
+			pass = 0;
+			boundTarget = nullptr;
+			boundDepthBuffer = nullptr;
+		}
+
+		[[nodiscard]]
+		size_t size() const
+		{
+			return commands.size();
+		}
+
+	private:
+
+		enum class CommandType
+		{
+			Clear,
+			BindTargets,
+			Draw
+		};
+
+		struct Command
+		{
+			CommandType type = CommandType::Draw;
+			DrawKind kind = DrawKind::Opaque;
+			uint32_t pass = 0;
+			float depth = .0f;
+			uint64_t model = 0;
+			const void *target = nullptr;
+			uint32_t sequence = 0;
+			std::function<DrawResult()> draw;
+			std::function<void()> applyBarrier;
+		};
+
+		void pushBarrier(CommandType type, const void *target, std::function<void()> applyBarrier)
+		{
+			pass++;
+			commands.push_back({
+				.type = type,
+				.pass = pass,
+				.target = target,
+				.sequence = static_cast<uint32_t>(commands.size()),
+				.draw = {},
+				.applyBarrier = std::move(applyBarrier)
+			});
+		}
+
+		//normalized device depth of the model's center, draws without a transform go after the others
+		static float calculateSortDepth(ModelHandle handle, const std::optional<mat4x4> &modelViewProjection)
+		{
+			const std::optional<AABB3> bounds = Rasterizer::boundsOf(handle);
+			if (!modelViewProjection.has_value() || !bounds.has_value())
+			{
+				return std::numeric_limits<float>::max();
+			}
+
+			const vec4 center = *modelViewProjection * vec4::fromPoint(bounds->center());
+			if (center.w() <= .0f)
+			{
+				//behind the viewer, it will most likely be culled anyway
+				return std::numeric_limits<float>::lowest();
+			}
+			return center.z() / center.w();
+		}
+
+		std::vector<Command> commands;
+		uint32_t pass = 0;
+		const void *boundTarget = nullptr;
+		const FrameBuffer<float> *boundDepthBuffer = nullptr;
+	};
+}
@@ -0,0 +1,151 @@
+#pragma once
+#include <array>
+#include <cmath>
+#include "vec.h"
+#include "mat.h"
+#include "AABB.h"
+
+namespace culling
+{
+	struct Sphere
+	{
+		vec3 center = {};
+		float radius = .0f;
+	};
+
+	//all the normals of a cluster are within acos(sqrt(1 - cutoff^2)) of the axis
+	//a cutoff of 1 means the cone is too wide to ever be culled
+	struct Cone
+	{
+		vec3 axis = {};
+		float cutoff = 1.0f;
+	};
+
+	struct Plane
+	{
+		vec3 normal = {};
+		float distance = .0f;
+
+		[[nodiscard]]
+		float signedDistance(const vec3 &point) const
+		{
+			return vec3::dot(normal, point) + distance;
+		}
+	};
+
+	//clip volume planes in the space the matrix transforms from, normals point inwards
+	struct Frustum
+	{
+		[[nodiscard]]
+		static Frustum fromMatrix(const mat4x4 &matrix)
+		{
+			//from : "Fast Extraction of Viewing Frustum Planes from the World-View-Projection Matrix" (Gribb, Hartmann)
+			const vec4 rows[4] = { matrix.rowAt(0), matrix.rowAt(1), matrix.rowAt(2), matrix.rowAt(3) };
+			const vec4 planeVectors[6] =
+			{
+				rows[3] + rows[0], //left
+				rows[3] - rows[0], //right
+				rows[3] + rows[1], //bottom
+				rows[3] - rows[1], //top
+				rows[3] + rows[2], //near
+				rows[3] - rows[2], //far
+			};
+
+			Frustum frustum = {};
+			for (size_t i = 0; i < frustum.planes.size(); i++)
+			{
+				const float length = planeVectors[i].xyz().length();
+				const float inverseLength = length > .0f ? 1.0f / length : .0f;
+				frustum.planes[i] = { .normal = planeVectors[i].xyz() * inverseLength, .distance = planeVectors[i].w() * inverseLength };
+			}
+			return frustum;
+		}
+
+		[[nodiscard]]
+		bool intersects(const Sphere &sphere) const
+		{
+			for (const Plane &plane : planes)
+			{
+				if (plane.signedDistance(sphere.center) < -sphere.radius) return false;
+			}
+			return true;
+		}
+
+		[[nodiscard]]
+		bool intersects(const AABB3 &box) const
+		{
+			for (const Plane &plane : planes)
+			{
+				//the corner furthest along the plane's normal
+				vec3 corner = box.min;
+				for (size_t i = 0; i < vec3::size(); i++)
+				{
+					if (plane.normal[i] > .0f) corner[i] = box.max[i];
+				}
+
+				if (plane.signedDistance(corner) < .0f) return false;
+			}
+			return true;
+		}
+
+		std::array<Plane, 6> planes = {};
+	};
+
+	//where the triangles are seen from, in the space the matrix transforms from
+	//oriented so that a triangle is backfacing when its normal points away from it, matching the rasterizer's winding
+	struct ViewPoint
+	{
+		[[nodiscard]]
+		static ViewPoint fromMatrix(const mat4x4 &matrix)
+		{
+			//the point (or direction, for parallel projections) every row but z maps to 0,
+			//found as the generalized cross product of the x, y and w rows
+			const vec4 x = matrix.rowAt(0), y = matrix.rowAt(1), w = matrix.rowAt(3);
+			auto minor = [&](size_t skippedColumn)
+			{
+				size_t columns[3] = {};
+				for (size_t i = 0, count = 0; i < 4; i++)
+				{
+					if (i != skippedColumn) columns[count++] = i;
+				}
+				return mat3x3({
+					x[columns[0]], x[columns[1]], x[columns[2]],
+					y[columns[0]], y[columns[1]], y[columns[2]],
+					w[columns[0]], w[columns[1]], w[columns[2]],
+					}).calculateDeterminant();
+			};
+			const vec4 eye = vec4(minor(0), -minor(1), minor(2), -minor(3));
+
+			ViewPoint viewPoint = {};
+			if (std::abs(eye.w()) > 1e-6f * eye.xyz().length())
+			{
+				viewPoint.position = eye.xyz() / eye.w();
+				viewPoint.orientation = eye.w() > .0f ? 1.0f : -1.0f;
+			}
+			else
+			{
+				viewPoint.isDirectional = true;
+				viewPoint.direction = (eye.xyz() * -1.0f).normalized();
+			}
+			return viewPoint;
+		}
+
+		[[nodiscard]]
+		bool isBackfacing(const Cone &cone, const Sphere &bounds) const
+		{
+			if (isDirectional)
+			{
+				return vec3::dot(direction, cone.axis) > cone.cutoff;
+			}
+
+			//from : https://github.com/zeux/meshoptimizer (meshopt_computeClusterBounds)
+			const vec3 toCenter = bounds.center - position;
+			return vec3::dot(toCenter, cone.axis * orientation) >= cone.cutoff * toCenter.length() + bounds.radius;
+		}
+
+		vec3 position = {};
+		float orientation = 1.0f;
+		vec3 direction = {};
+		bool isDirectional = false;
+	};
+}
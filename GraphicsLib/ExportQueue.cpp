@@ -0,0 +1,166 @@
+#include "ExportQueue.h"
+#include "MappedFile.h"
+#include "PNGWriter.h"
+#include "Profiler.h"
+#include "QOIWriter.h"
+
+#include <algorithm>
+#include <exception>
+#include <string_view>
+
+namespace gl
+{
+	ExportQueue::ExportQueue(size_t maxQueuedFrames) :
+		maxQueuedFrames(maxQueuedFrames > 0 ? maxQueuedFrames : 1),
+		exportThread(&ExportQueue::exportLoop, this)
+	{
+	}
+
+	ExportQueue::~ExportQueue()
+	{
+		{
+			std::lock_guard lock(mutex);
+			isStopping = true;
+		}
+		frameQueued.notify_one();
+		exportThread.join();
+	}
+
+	void ExportQueue::flush()
+	{
+		std::unique_lock lock(mutex);
+		frameWritten.wait(lock, [this]() { return queuedFrames.empty() && !isWriting; });
+	}
+
+	ExportQueue::Stats ExportQueue::stats() const
+	{
+		std::lock_guard lock(mutex);
+		return statistics;
+	}
+
+	std::unique_ptr<ExportQueue::Frame> ExportQueue::acquireFrame(bool isWaiting)
+	{
+		std::unique_lock lock(mutex);
+		const auto hasRoom = [this]() { return queuedFrames.size() + reservedFrames < maxQueuedFrames; };
+		if (!hasRoom())
+		{
+			if (!isWaiting)
+			{
+				statistics.droppedFrames++;
+				return nullptr;
+			}
+
+			const auto stallStart = std::chrono::steady_clock::now();
+			frameWritten.wait(lock, hasRoom);
+			statistics.stalledSubmissions++;
+			statistics.stallTime += std::chrono::steady_clock::now() - stallStart;
+		}
+		reservedFrames++;
+
+		if (freeFrames.empty())
+		{
+			return std::make_unique<Frame>();
+		}
+
+		std::unique_ptr<Frame> frame = std::move(freeFrames.back());
+		freeFrames.pop_back();
+		return frame;
+	}
+
+	void ExportQueue::enqueue(std::unique_ptr<Frame> frame)
+	{
+		{
+			std::lock_guard lock(mutex);
+			reservedFrames--;
+			queuedFrames.push_back(std::move(frame));
+			statistics.submittedFrames++;
+			statistics.maxQueuedFrames = std::max(statistics.maxQueuedFrames, queuedFrames.size());
+		}
+		frameQueued.notify_one();
+	}
+
+	void ExportQueue::exportLoop()
+	{
+		Profiler::nameThread("export queue");
+		std::unique_lock lock(mutex);
+		while (true)
+		{
+			frameQueued.wait(lock, [this]() { return isStopping || !queuedFrames.empty(); });
+			//what's left is written before stopping
+			if (queuedFrames.empty()) return;
+
+			std::unique_ptr<Frame> frame = std::move(queuedFrames.front());
+			queuedFrames.pop_front();
+			isWriting = true;
+
+			lock.unlock();
+			bool isWritten = true;
+			try
+			{
+				write(*frame);
+			}
+			catch (const std::exception &)
+			{
+				//there's no one to report to on this thread, the stats tell
+				isWritten = false;
+			}
+			lock.lock();
+
+			isWriting = false;
+			(isWritten ? statistics.writtenFrames : statistics.failedFrames)++;
+			freeFrames.push_back(std::move(frame));
+			frameWritten.notify_all();
+		}
+	}
+
+	void ExportQueue::write(const Frame &frame)
+	{
+		PROFILE_ZONE("export");
+		//converted on this thread only, the job system's workers are the render loop's
+		const auto convert = [&frame](uint8_t *out, ColorConversion::ChannelOrder order, bool isTopDown)
+		{
+			const ColorConversion::Info conversionInfo = { .order = order, .encoding = frame.encoding, .isTopDown = isTopDown, .isParallel = false };
+			if (frame.channelCount == 1)
+			{
+				ColorConversion::convert(frame.pixels.data(), frame.width, frame.height, out, conversionInfo);
+			}
+			else
+			{
+				ColorConversion::convert(reinterpret_cast<const vec4 *>(frame.pixels.data()), frame.width, frame.height, out, conversionInfo);
+			}
+		};
+
+		const std::string_view path = frame.path;
+		const uint32_t width = static_cast<uint32_t>(frame.width);
+		const uint32_t height = static_cast<uint32_t>(frame.height);
+		const size_t pixelCount = frame.width * frame.height;
+		if (path.ends_with(".png") || path.ends_with(".qoi"))
+		{
+			//the encoders take bitmap pixels, starting from the bottom row like framebuffers
+			convertedPixels.resize(pixelCount);
+			convert(reinterpret_cast<uint8_t *>(convertedPixels.data()), ColorConversion::ChannelOrder::BGRA, false);
+			if (path.ends_with(".png"))
+			{
+				//not on the workers either : waiting on them would let this thread run a job submitting to this very queue
+				png::write({ .path = frame.path.c_str(), .xPixelCount = width, .yPixelCount = height, .contents = convertedPixels.data(), .isParallel = false });
+			}
+			else
+			{
+				qoi::write({ .path = frame.path.c_str(), .xPixelCount = width, .yPixelCount = height, .contents = convertedPixels.data() });
+			}
+		}
+		else if (path.ends_with(".raw"))
+		{
+			MappedFile file(frame.path.c_str(), pixelCount * 4);
+			convert(file.data(), ColorConversion::ChannelOrder::RGBA, true);
+		}
+		else
+		{
+			//the pixels are converted straight into the file, right after the headers
+			const bmp::details::BMPHeader header = bmp::makeHeader(width, height);
+			MappedFile file(frame.path.c_str(), sizeof(header) + pixelCount * sizeof(bmp::color));
+			std::memcpy(file.data(), &header, sizeof(header));
+			convert(file.data() + sizeof(header), ColorConversion::ChannelOrder::BGRA, false);
+		}
+	}
+}
@@ -0,0 +1,138 @@
+#pragma once
+#include "Framebuffer.h"
+#include "BMPWriter.h"
+#include "ColorConversion.h"
+#include "JobSystem.h"
+#include "vec.h"
+
+#include <cassert>
+#include <chrono>
+#include <concepts>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace gl
+{
+	//writes framebuffers to files on a thread of its own, so that the render loop only pays for a copy
+	//frames are copied to pooled buffers, and converted and written in submission order
+	class ExportQueue
+	{
+	public:
+
+		struct Stats
+		{
+			size_t submittedFrames = 0;
+			//trySubmit calls that found the queue full
+			size_t droppedFrames = 0;
+			size_t writtenFrames = 0;
+			//frames whose file couldn't be written
+			size_t failedFrames = 0;
+			//submissions that had to wait for the queue to have room, and for how long in total
+			size_t stalledSubmissions = 0;
+			std::chrono::nanoseconds stallTime = {};
+			size_t maxQueuedFrames = 0;
+		};
+
+		//submissions block, or are dropped for trySubmit, while maxQueuedFrames are waiting to be written
+		explicit ExportQueue(size_t maxQueuedFrames = 4);
+		//writes every frame still queued
+		~ExportQueue();
+
+		ExportQueue(const ExportQueue &) = delete;
+		ExportQueue &operator=(const ExportQueue &) = delete;
+
+		//float images are written as grayscale, vec4 ones as their rgb channels, both expected within [0, 1]
+		//color images meant to be looked at are sRGB encoded, data such as depth is better kept linear
+		//the file's format follows the path's extension : .png, .qoi, .raw for rgba bytes starting from the top row, or a bitmap for any other
+		//waits for room in the queue, which the job system's workers shouldn't do : they'd hold up the jobs the render loop waits on
+		template<typename T>
+		void submit(const FrameBuffer<T> &image, std::string path, ColorConversion::Encoding encoding = ColorConversion::Encoding::Linear) requires (std::same_as<T, float> || std::same_as<T, vec4>)
+		{
+			assert(!JobSystem::isWorkerThread());
+
+			std::unique_ptr<Frame> frame = acquireFrame(true);
+			copy(*frame, image, std::move(path), encoding);
+			enqueue(std::move(frame));
+		}
+
+		//submits without waiting, for jobs, the frame is dropped and counted when the queue is full
+		//returns whether the frame was queued
+		template<typename T>
+		bool trySubmit(const FrameBuffer<T> &image, std::string path, ColorConversion::Encoding encoding = ColorConversion::Encoding::Linear) requires (std::same_as<T, float> || std::same_as<T, vec4>)
+		{
+			std::unique_ptr<Frame> frame = acquireFrame(false);
+			if (frame == nullptr) return false;
+
+			copy(*frame, image, std::move(path), encoding);
+			enqueue(std::move(frame));
+			return true;
+		}
+
+		//waits for every frame submitted so far to be written
+		void flush();
+
+		[[nodiscard]]
+		Stats stats() const;
+
+	private:
+
+		struct Frame
+		{
+			size_t width = 0, height = 0;
+			size_t channelCount = 0;
+			ColorConversion::Encoding encoding = ColorConversion::Encoding::Linear;
+			std::string path;
+			std::vector<float> pixels;
+		};
+
+		template<typename T>
+		static void copy(Frame &frame, const FrameBuffer<T> &image, std::string path, ColorConversion::Encoding encoding)
+		{
+			//multisampled images have to be resolved first
+			assert(image.sampleCount == 1);
+
+			constexpr size_t channelCount = sizeof(T) / sizeof(float);
+			frame.width = image.width;
+			frame.height = image.height;
+			frame.channelCount = channelCount;
+			frame.encoding = encoding;
+			frame.path = std::move(path);
+			frame.pixels.resize(image.width * image.height * channelCount);
+			std::memcpy(frame.pixels.data(), image.data, frame.pixels.size() * sizeof(float));
+		}
+
+		//reserves room in the queue, then takes a buffer from the pool, or a new one when they are all in use
+		//without waiting, there's no frame when the queue is full
+		std::unique_ptr<Frame> acquireFrame(bool isWaiting);
+		void enqueue(std::unique_ptr<Frame> frame);
+		void exportLoop();
+		void write(const Frame &frame);
+
+		const size_t maxQueuedFrames;
+
+		mutable std::mutex mutex;
+		std::condition_variable frameQueued;
+		//signaled whenever a frame is done, for the submissions waiting for room and flush
+		std::condition_variable frameWritten;
+		std::deque<std::unique_ptr<Frame>> queuedFrames;
+		std::vector<std::unique_ptr<Frame>> freeFrames;
+		//acquired frames still being copied to, which already count against maxQueuedFrames
+		size_t reservedFrames = 0;
+		//the frame being written isn't queued anymore, but flush still has to wait for it
+		bool isWriting = false;
+		bool isStopping = false;
+		Stats statistics;
+
+		//only used by the export thread for the encoders, kept from one frame to the next
+		//bitmaps and raw files are converted straight into their mapped file instead
+		std::vector<bmp::color> convertedPixels;
+
+		std::thread exportThread;
+	};
+}
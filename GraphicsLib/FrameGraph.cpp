@@ -0,0 +1,107 @@
+#include "FrameGraph.h"
+#include "Profiler.h"
+
+#include <algorithm>
+
+namespace gl
+{
+	FrameGraph::~FrameGraph()
+	{
+		waitIdle();
+	}
+
+	void FrameGraph::addPass(const char *name, std::initializer_list<Resource> reads, std::initializer_list<Resource> writes, std::function<void()> execute)
+	{
+		auto pass = std::make_shared<Pass>();
+		pass->name = name;
+		pass->execute = std::move(execute);
+
+		auto dependOn = [&pass](const std::shared_ptr<Pass> &dependency)
+		{
+			if (dependency != nullptr &&
+				std::find(pass->dependencies.begin(), pass->dependencies.end(), dependency) == pass->dependencies.end())
+			{
+				pass->dependencies.push_back(dependency);
+			}
+		};
+
+		//dependencies are found before updating any state, a pass can read and write the same resource
+		for (const Resource resource : reads)
+		{
+			dependOn(resources[resource].writer);
+		}
+		for (const Resource resource : writes)
+		{
+			const ResourceState &state = resources[resource];
+			dependOn(state.writer);
+			for (const std::shared_ptr<Pass> &reader : state.readers)
+			{
+				dependOn(reader);
+			}
+		}
+
+		for (const Resource resource : reads)
+		{
+			resources[resource].readers.push_back(pass);
+		}
+		for (const Resource resource : writes)
+		{
+			ResourceState &state = resources[resource];
+			state.writer = pass;
+			state.readers.clear();
+		}
+
+		pendingPasses.push_back(std::move(pass));
+	}
+
+	void FrameGraph::submitFrame()
+	{
+		for (const std::shared_ptr<Pass> &pass : pendingPasses)
+		{
+			//each dependency decrements the inputs once it's done, through an empty job
+			for (const std::shared_ptr<Pass> &dependency : pass->dependencies)
+			{
+				JobSystem::runAfter(dependency->done, [pass]() {}, &pass->inputs);
+			}
+
+			JobSystem::runAfter(pass->inputs, [pass]()
+			{
+				PROFILE_ZONE(pass->name);
+				pass->execute();
+				//finished passes don't need to keep the ones before them alive
+				pass->dependencies.clear();
+			}, &pass->done);
+		}
+
+		framesInFlight.push_back(std::move(pendingPasses));
+		pendingPasses.clear();
+
+		while (framesInFlight.size() > maxFramesInFlight)
+		{
+			waitFor(framesInFlight.front());
+			framesInFlight.pop_front();
+		}
+	}
+
+	void FrameGraph::waitIdle()
+	{
+		if (!pendingPasses.empty())
+		{
+			submitFrame();
+		}
+
+		while (!framesInFlight.empty())
+		{
+			waitFor(framesInFlight.front());
+			framesInFlight.pop_front();
+		}
+	}
+
+	void FrameGraph::waitFor(std::vector<std::shared_ptr<Pass>> &frame)
+	{
+		for (const std::shared_ptr<Pass> &pass : frame)
+		{
+			JobSystem::wait(pass->done);
+		}
+	}
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include "JobSystem.h"
+
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <deque>
+
+namespace gl
+{
+	//runs passes on the job system as soon as the resources they use are ready
+	//resources are identified by their address, usually framebuffers, and tracked across frames
+	//so that a pass of the next frame only waits on the passes of this one that touch the same resources
+	class FrameGraph
+	{
+	public:
+		using Resource = const void *;
+
+		explicit FrameGraph(size_t maxFramesInFlight = 2) : maxFramesInFlight(maxFramesInFlight) {}
+		~FrameGraph();
+
+		FrameGraph(const FrameGraph &) = delete;
+		FrameGraph &operator=(const FrameGraph &) = delete;
+
+		//a pass runs after every earlier pass writing to what it reads, and every earlier pass using what it writes
+		//its execution is profiled under its name, which has to outlive the profiler
+		void addPass(const char *name, std::initializer_list<Resource> reads, std::initializer_list<Resource> writes, std::function<void()> execute);
+
+		//schedules the passes added since the last submission
+		//then waits for the oldest frames until no more than maxFramesInFlight are still running
+		void submitFrame();
+
+		//waits for every submitted pass
+		void waitIdle();
+
+	private:
+
+		struct Pass
+		{
+			const char *name;
+			std::function<void()> execute;
+			std::vector<std::shared_ptr<Pass>> dependencies;
+			//counts the dependencies still running
+			JobCounter inputs;
+			JobCounter done;
+		};
+
+		struct ResourceState
+		{
+			std::shared_ptr<Pass> writer;
+			std::vector<std::shared_ptr<Pass>> readers;
+		};
+
+		static void waitFor(std::vector<std::shared_ptr<Pass>> &frame);
+
+		size_t maxFramesInFlight;
+		std::vector<std::shared_ptr<Pass>> pendingPasses;
+		std::deque<std::vector<std::shared_ptr<Pass>>> framesInFlight;
+		std::unordered_map<Resource, ResourceState> resources;
+	};
+}
@@ -2,6 +2,14 @@
 #include <cmath>
 #include "AABB.h"
 #include "Sampling.h"
+#include "Simd.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <span>
+#include <cstdint>
+#include <cstring>
+#include <concepts>
 #include <assert.h>
 
 namespace gl
@@ -16,14 +24,18 @@ namespace gl
 			size_t width = 0;
 			size_t height = 0; 
 			T clearValue = {};
+			//1, 2, 4 or 8, multisampled framebuffers have to be resolved before being read from as images
+			uint32_t sampleCount = 1;
 		};
 
 		FrameBuffer(const CreateInfo &info) :
 			width(info.width),
 			height(info.height),
-			data(new T[info.width * info.height]),
+			sampleCount(info.sampleCount),
+			data(new T[info.width * info.height * info.sampleCount]),
 			clearValue(info.clearValue)
 		{
+			assert(!samplePattern(sampleCount).empty());
 			clear();
 		}
 
@@ -32,16 +44,30 @@ namespace gl
 			delete[] data;
 		}
 
+		//the first sample of the texel when multisampled
 		[[nodiscard]]
 		const T& atTexel(size_t x, size_t y) const
 		{
-			return data[x + width * y];
+			return data[(x + width * y) * sampleCount];
 		}
 
 		[[nodiscard]]
 		T &atTexel(size_t x, size_t y)
 		{
-			return data[x + width * y];
+			return data[(x + width * y) * sampleCount];
+		}
+
+		//the samples of a texel are next to each other
+		[[nodiscard]]
+		const T &atSample(size_t x, size_t y, uint32_t sample) const
+		{
+			return data[(x + width * y) * sampleCount + sample];
+		}
+
+		[[nodiscard]]
+		T &atSample(size_t x, size_t y, uint32_t sample)
+		{
+			return data[(x + width * y) * sampleCount + sample];
 		}
 
 		[[nodiscard]]
@@ -82,15 +108,120 @@ namespace gl
 			}
 		}
 
+		//fraction of the comparisons around u, v where reference is closer than what the buffer holds, 1 meaning lit for shadow maps
+		//the comparisons are filtered rather than the depths, and texels beyond the edges are clamped to them
+		//reference and the sampler's bias are in the unit of the buffer's values, raw 16 bit values for 16 bit buffers
+		[[nodiscard]]
+		float sampleCompare(float u, float v, float reference, const sampling::CompareSampler &sampler = {}) const requires (std::same_as<T, float> || std::same_as<T, uint16_t>)
+		{
+			reference -= sampler.depthBias;
+			//texel centers are at whole coordinates from here on
+			const float texelX = u * static_cast<float>(width) - .5f;
+			const float texelY = v * static_cast<float>(height) - .5f;
+
+			auto compareGrid = [&](int radius)
+			{
+				float lit = .0f;
+				for (int y = -radius; y <= radius; y++)
+				for (int x = -radius; x <= radius; x++)
+				{
+					lit += compareBilinear(texelX + static_cast<float>(x), texelY + static_cast<float>(y), reference);
+				}
+				const float tapCount = static_cast<float>((2 * radius + 1) * (2 * radius + 1));
+				return lit / tapCount;
+			};
+
+			switch (sampler.filter)
+			{
+			case sampling::CompareFilter::Nearest:
+			{
+				const size_t x = clampX(static_cast<ptrdiff_t>(std::floor(texelX + .5f)));
+				const size_t y = clampY(static_cast<ptrdiff_t>(std::floor(texelY + .5f)));
+				return reference < static_cast<float>(atTexel(x, y)) ? 1.0f : .0f;
+			}
+			case sampling::CompareFilter::Bilinear:
+				return compareBilinear(texelX, texelY, reference);
+			case sampling::CompareFilter::Grid3x3:
+				return compareGrid(1);
+			case sampling::CompareFilter::Grid5x5:
+				return compareGrid(2);
+			case sampling::CompareFilter::Poisson16:
+			{
+				float lit = .0f;
+				for (const std::array<float, 2> &offset : sampling::poissonDisk)
+				{
+					lit += compareBilinear(texelX + offset[0] * sampler.poissonRadius, texelY + offset[1] * sampler.poissonRadius, reference);
+				}
+				return lit / static_cast<float>(sampling::poissonDisk.size());
+			}
+			default:
+				assert(false);
+				return 1.0f;
+			}
+		}
+
 		void clear()
 		{
-			for (size_t i = 0; i < width * height; i++)
+			PROFILE_ZONE("clear");
+			constexpr size_t rowsPerJob = 32;
+			JobSystem::parallelFor(height, rowsPerJob, [this](size_t beginRow, size_t endRow)
 			{
-				data[i] = clearValue;
+				std::fill(data + beginRow * width * sampleCount, data + endRow * width * sampleCount, clearValue);
+			});
+		}
+
+		//averages the samples of every texel into a framebuffer of the same size with a single sample
+		void resolve(FrameBuffer<T> &destination) const
+		{
+			assert(destination.width == width && destination.height == height && destination.sampleCount == 1);
+
+			constexpr size_t rowsPerJob = 32;
+			const float weight = 1.0f / static_cast<float>(sampleCount);
+			JobSystem::parallelFor(height, rowsPerJob, [this, &destination, weight](size_t beginRow, size_t endRow)
+			{
+				for (size_t texel = beginRow * width; texel < endRow * width; texel++)
+				{
+					const T *samples = data + texel * sampleCount;
+					T sum = samples[0];
+					for (uint32_t i = 1; i < sampleCount; i++)
+					{
+						sum = sum + samples[i];
+					}
+					destination.data[texel] = sum * weight;
+				}
+			});
+		}
+
+		//standard sample positions, relative to the point a single sampled texel is sampled at
+		//empty for unsupported sample counts
+		[[nodiscard]]
+		static std::span<const vec2> samplePattern(uint32_t sampleCount)
+		{
+			//in sixteenths of a texel
+			static const vec2 single[] = { vec2(.0f, .0f) };
+			static const vec2 twoSamples[] = { vec2(4.0f, 4.0f) / 16.0f, vec2(-4.0f, -4.0f) / 16.0f };
+			static const vec2 fourSamples[] = 
+			{ 
+				vec2(-2.0f, -6.0f) / 16.0f, vec2(6.0f, -2.0f) / 16.0f, vec2(-6.0f, 2.0f) / 16.0f, vec2(2.0f, 6.0f) / 16.0f 
+			};
+			static const vec2 eightSamples[] =
+			{
+				vec2(1.0f, -3.0f) / 16.0f, vec2(-1.0f, 3.0f) / 16.0f, vec2(5.0f, 1.0f) / 16.0f, vec2(-3.0f, -5.0f) / 16.0f,
+				vec2(-5.0f, 5.0f) / 16.0f, vec2(-7.0f, -1.0f) / 16.0f, vec2(3.0f, 7.0f) / 16.0f, vec2(7.0f, -7.0f) / 16.0f
+			};
+
+			switch (sampleCount)
+			{
+			case 1: return single;
+			case 2: return twoSamples;
+			case 4: return fourSamples;
+			case 8: return eightSamples;
+			default: return {};
 			}
 		}
 
 		size_t width = {}, height = {};
+		uint32_t sampleCount = 1;
 		T *data = nullptr;
 
 		[[nodiscard]]
@@ -102,5 +233,85 @@ namespace gl
 		}
 
 		const T clearValue;
+
+	private:
+
+		[[nodiscard]]
+		size_t clampX(ptrdiff_t x) const
+		{
+			return static_cast<size_t>(std::clamp<ptrdiff_t>(x, 0, static_cast<ptrdiff_t>(width) - 1));
+		}
+
+		[[nodiscard]]
+		size_t clampY(ptrdiff_t y) const
+		{
+			return static_cast<size_t>(std::clamp<ptrdiff_t>(y, 0, static_cast<ptrdiff_t>(height) - 1));
+		}
+
+		//the four comparisons around texelX, texelY weighted by how close their texel is
+		[[nodiscard]]
+		float compareBilinear(float texelX, float texelY, float reference) const
+		{
+			const float floorX = std::floor(texelX);
+			const float floorY = std::floor(texelY);
+			const float fractionX = texelX - floorX;
+			const float fractionY = texelY - floorY;
+			const ptrdiff_t x = static_cast<ptrdiff_t>(floorX);
+			const ptrdiff_t y = static_cast<ptrdiff_t>(floorY);
+
+#ifdef SIMD_SSE2
+			//lanes are the bottom left, bottom right, top left and top right texels
+			const __m128 depths = loadFootprint(x, y);
+			const __m128 lit = _mm_and_ps(_mm_cmplt_ps(_mm_set1_ps(reference), depths), _mm_set1_ps(1.0f));
+			const __m128 weights = _mm_mul_ps(
+				_mm_set_ps(fractionX, 1.0f - fractionX, fractionX, 1.0f - fractionX),
+				_mm_set_ps(fractionY, fractionY, 1.0f - fractionY, 1.0f - fractionY));
+
+			const __m128 weighted = _mm_mul_ps(lit, weights);
+			const __m128 pairs = _mm_add_ps(weighted, _mm_movehl_ps(weighted, weighted));
+			return _mm_cvtss_f32(_mm_add_ss(pairs, _mm_shuffle_ps(pairs, pairs, _MM_SHUFFLE(1, 1, 1, 1))));
+#else
+			auto compare = [this, reference](ptrdiff_t compareX, ptrdiff_t compareY)
+			{
+				return reference < static_cast<float>(atTexel(clampX(compareX), clampY(compareY))) ? 1.0f : .0f;
+			};
+			const float bottom = std::lerp(compare(x, y), compare(x + 1, y), fractionX);
+			const float top = std::lerp(compare(x, y + 1), compare(x + 1, y + 1), fractionX);
+			return std::lerp(bottom, top, fractionY);
+#endif
+		}
+
+#ifdef SIMD_SSE2
+		//the 2x2 texels starting at x, y as floats, loaded a row at a time when they're all within the buffer
+		[[nodiscard]]
+		__m128 loadFootprint(ptrdiff_t x, ptrdiff_t y) const
+		{
+			const bool isInside = sampleCount == 1 && 
+				x >= 0 && y >= 0 && x + 1 < static_cast<ptrdiff_t>(width) && y + 1 < static_cast<ptrdiff_t>(height);
+			if (!isInside)
+			{
+				const size_t left = clampX(x), right = clampX(x + 1);
+				const size_t bottom = clampY(y), top = clampY(y + 1);
+				return _mm_set_ps(
+					static_cast<float>(atTexel(right, top)), static_cast<float>(atTexel(left, top)),
+					static_cast<float>(atTexel(right, bottom)), static_cast<float>(atTexel(left, bottom)));
+			}
+
+			const T *bottomRow = data + x + static_cast<ptrdiff_t>(width) * y;
+			const T *topRow = bottomRow + width;
+			if constexpr (std::same_as<T, float>)
+			{
+				return _mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), reinterpret_cast<const __m64 *>(bottomRow)), reinterpret_cast<const __m64 *>(topRow));
+			}
+			else
+			{
+				int32_t bottomPair = 0, topPair = 0;
+				std::memcpy(&bottomPair, bottomRow, sizeof(bottomPair));
+				std::memcpy(&topPair, topRow, sizeof(topPair));
+				const __m128i packed = _mm_unpacklo_epi32(_mm_cvtsi32_si128(bottomPair), _mm_cvtsi32_si128(topPair));
+				return _mm_cvtepi32_ps(_mm_unpacklo_epi16(packed, _mm_setzero_si128()));
+			}
+		}
+#endif
 	};
 }
@@ -9,9 +9,25 @@
 #include "Utilities.h"
 #include "AABB.h"
 #include "CommonConcepts.h"
+#include "MeshOptimizer.h"
+#include "Meshlets.h"
+#include "Culling.h"
+#include "PipelineStatistics.h"
+#include "JobSystem.h"
+#include "Profiler.h"
 
 #include <vector>
 #include <unordered_map>
+#include <optional>
+#include <algorithm>
+#include <span>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <bit>
+#include <type_traits>
+#include <limits>
+#include <numeric>
 
 namespace gl
 {
@@ -38,13 +54,77 @@ namespace gl
 		Attributes_t attributes;
 	};
 
+	//the 2x2 texels a fragment is shaded along with, for screen space derivatives
+	//texels of the quad the triangle doesn't cover are still interpolated, their inputs extrapolated from the triangle's
+	template<Attributes Attributes_t>
+	struct FragmentQuad
+	{
+		//how much selector(vertex, attributes) changes from one texel to the next along x, in the fragment's row
+		template<typename Selector_t>
+		[[nodiscard]]
+		auto ddx(const Selector_t &selector) const
+		{
+			const size_t row = lane & 2;
+			return selector(vertices[row + 1], attributes[row + 1]) - selector(vertices[row], attributes[row]);
+		}
+
+		//how much selector(vertex, attributes) changes from one texel to the next along y, in the fragment's column
+		template<typename Selector_t>
+		[[nodiscard]]
+		auto ddy(const Selector_t &selector) const
+		{
+			const size_t column = lane & 1;
+			return selector(vertices[column + 2], attributes[column + 2]) - selector(vertices[column], attributes[column]);
+		}
+
+		//lane x + 2 * y holds the texel at x, y from the quad's first texel
+		std::array<Triangle::Vertex, 4> vertices = {};
+		std::array<Attributes_t, 4> attributes = {};
+		//the fragment being shaded
+		size_t lane = 0;
+	};
+
+	//fragment shaders taking a FragmentQuad as their third parameter are shaded in quads
+	template<typename Fragment_t, typename Attributes_t>
+	constexpr bool usesFragmentQuads = std::is_invocable_v<Fragment_t &, const Triangle::Vertex &, const Attributes_t &, const FragmentQuad<Attributes_t> &>;
+
+	//what a visibility buffer holds for each sample, enough to find and shade the fragment later on
+	struct VisibilitySample
+	{
+		static constexpr uint32_t noTriangle = std::numeric_limits<uint32_t>::max();
+
+		//the meshlet times Meshlet::maxTriangles, plus the triangle within the meshlet
+		uint32_t triangleId = noTriangle;
+		//DrawInfo::instanceId, plus the instance's index for instanced draws
+		uint32_t instanceId = 0;
+		//weights of the triangle's second and third vertices, the first one's is what's left
+		std::array<float, 2> barycentrics = {};
+	};
+
 	template<typename RenderTarget_t, Shader Vertex_t, Shader Fragment_t, Attributes Attributes_t>
 	struct DrawInfo
 	{
 		FrameBuffer<RenderTarget_t> &target;
+		//both shaders are called from several threads at once, they shouldn't write to anything they share
 		Vertex_t vertexShader;
 		Fragment_t fragmentShader;
 		FrameBuffer<float>* depthBuffer = nullptr;
+		//model to clip space transform matching what the vertex shader does to positions
+		//when set, clusters outside of the clip volume or facing away from the viewer are skipped before any vertex work
+		//for instanced draws, each instance's transform is applied before this one
+		std::optional<mat4x4> modelViewProjection = {};
+		//written to visibility buffers, and which of their samples are shaded when resolving them
+		uint32_t instanceId = 0;
+		//when set, and statistics are compiled in, the draw's counters are added to it once it's done
+		//draws running at the same time need their own
+		PipelineStatistics *statistics = nullptr;
+	};
+
+	template<typename Payload_t>
+	struct Instance
+	{
+		mat4x4 transform;
+		Payload_t payload;
 	};
 
 	template<typename RenderTarget_t, Attributes Attributes_t>
@@ -59,16 +139,105 @@ namespace gl
 		};
 	};
 
+	//fragment shader of draws that only write depth, which the depth test already does
+	struct DepthOnly
+	{
+	};
+
+	//fragment shader of occlusion queries, which count the samples passing the depth test without writing anything
+	struct OcclusionQuery
+	{
+	};
+
+	//16 bit depth buffers hold normalized device depth, mapped from [-1, 1] to their whole range and rounded
+	[[nodiscard]]
+	inline uint16_t encodeUnorm16Depth(float depth)
+	{
+		const float normalized = std::clamp(depth * .5f + .5f, .0f, 1.0f);
+		return static_cast<uint16_t>(normalized * 65535.0f + .5f);
+	}
+
+	[[nodiscard]]
+	inline float decodeUnorm16Depth(uint16_t value)
+	{
+		return static_cast<float>(value) * (2.0f / 65535.0f) - 1.0f;
+	}
+
+	//draws only writing depth use the depth buffer as their target, no fragment being shaded
+	template<Attributes Attributes_t>
+	auto makeDepthOnlyDrawInfo(FrameBuffer<float> &depthBuffer, auto vertexShader)
+	{
+		return makeDrawInfo<float, Attributes_t>(depthBuffer, vertexShader, DepthOnly{}, &depthBuffer);
+	}
+
+	//16 bit targets are depth tested and written in their own encoding, without any float depth buffer
+	template<Attributes Attributes_t>
+	auto makeDepthOnlyDrawInfo(FrameBuffer<uint16_t> &depthBuffer, auto vertexShader)
+	{
+		return makeDrawInfo<uint16_t, Attributes_t>(depthBuffer, vertexShader, DepthOnly{});
+	}
+
+	//draws to a visibility buffer only run the vertex shader, the rasterizer writes the samples itself
+	template<Attributes Attributes_t>
+	auto makeVisibilityDrawInfo(FrameBuffer<VisibilitySample> &target, auto vertexShader, FrameBuffer<float> *depthBuffer = nullptr)
+	{
+		auto unusedFragmentShader = [](const Triangle::Vertex &, const Attributes_t &) { return VisibilitySample{}; };
+		return makeDrawInfo<VisibilitySample, Attributes_t>(target, vertexShader, unusedFragmentShader, depthBuffer);
+	}
+
+	enum class DrawResult
+	{
+		Drawn,
+		//the model's bounds are outside of the clip volume, nothing was shaded
+		Culled,
+		ModelNotFound
+	};
+
+	struct UploadInfo
+	{
+		//reorders the model for vertex cache reuse, reduced overdraw and vertex fetch locality
+		bool optimize = false;
+	};
+
 	class Rasterizer
 	{
 	public:
 
 		[[nodiscard]]
-		static ModelHandle uploadModel(Model &&model)
+		static ModelHandle uploadModel(Model &&model, const UploadInfo &info = {})
 		{
+			IndexedMesh mesh = MeshOptimizer::buildIndexedMesh(model.get());
+			if (info.optimize)
+			{
+				MeshOptimizer::optimize(mesh);
+			}
+			MeshletMesh meshlets = MeshletBuilder::build(mesh);
+
+			AABB3 bounds = {};
+			if (!mesh.vertices.empty())
+			{
+				bounds = AABB3(mesh.vertices[0].position.xyz(), mesh.vertices[0].position.xyz());
+				for (const Triangle::Vertex &vertex : mesh.vertices)
+				{
+					bounds.enclose(vertex.position.xyz());
+				}
+			}
+
+			culling::Sphere boundingSphere = { .center = bounds.center(), .radius = .0f };
+			for (const Triangle::Vertex &vertex : mesh.vertices)
+			{
+				boundingSphere.radius = std::max(boundingSphere.radius, (vertex.position.xyz() - boundingSphere.center).length());
+			}
+
 			static uint64_t nextHandle = 0U;
 			nextHandle++;
-			models[ModelHandle(nextHandle)] = std::move(model);
+			models[ModelHandle(nextHandle)] = UploadedModel
+			{
+				.mesh = std::move(mesh), 
+				.meshlets = std::move(meshlets),
+				.bounds = bounds,
+				.boundingSphere = boundingSphere
+			};
 			return nextHandle;
 		}
 
@@ -81,125 +250,999 @@ namespace gl
 			}
 		}
 
+		//model space bounds computed at upload
+		[[nodiscard]]
+		static std::optional<AABB3> boundsOf(ModelHandle handle)
+		{
+			if (const auto found = models.find(handle);
+				found != models.end())
+			{
+				return (*found).second.bounds;
+			}
+			return std::nullopt;
+		}
+
+		//whether a draw of the model with this transform would be rejected as a whole
+		[[nodiscard]]
+		static bool isCulled(ModelHandle handle, const mat4x4 &modelViewProjection)
+		{
+			if (const auto found = models.find(handle);
+				found != models.end())
+			{
+				return isCulled((*found).second, culling::Frustum::fromMatrix(modelViewProjection));
+			}
+			return true;
+		}
+
+		//how many samples of the box would pass the depth test against what the depth buffer holds, nothing being written
+		//none passing means that whatever is within the box is hidden by what was drawn before, and doesn't need to be drawn
+		//boxes reaching in front of the near plane can't be rasterized without clipping, they're reported as covering every sample
+		//the depth buffer is the query draw's render target, which is only read
+		[[nodiscard]]
+		static uint64_t queryOcclusion(const AABB3 &box, const mat4x4 &modelViewProjection, FrameBuffer<float> &depthBuffer)
+		{
+			PROFILE_ZONE("queryOcclusion");
+			if (!culling::Frustum::fromMatrix(modelViewProjection).intersects(box)) return 0;
+
+			auto unusedVertexShader = [](const Triangle::Vertex &vertex) { return VertexReturn<NoAttributes>{ vertex, {} }; };
+			auto drawInfo = makeDrawInfo<float, NoAttributes>(depthBuffer, unusedVertexShader, OcclusionQuery{}, &depthBuffer);
+			const mat4x4 viewportMat = calculateViewportMat(drawInfo);
+
+			std::array<Triangle::Vertex, 8> corners = {};
+			for (size_t i = 0; i < corners.size(); i++)
+			{
+				const vec3 corner = vec3((i & 1) ? box.max.x() : box.min.x(), (i & 2) ? box.max.y() : box.min.y(), (i & 4) ? box.max.z() : box.min.z());
+				vec4 position = modelViewProjection * vec4::fromPoint(corner);
+				if (position.w() <= .0f || position.z() < -position.w())
+				{
+					return uint64_t(depthBuffer.width) * depthBuffer.height * depthBuffer.sampleCount;
+				}
+				position = viewportMat * position;
+				position /= position.w();
+				corners[i].position = position;
+			}
+
+			//corners of each face, counter clockwise seen from outside, so that only the faces towards the viewer are set up
+			constexpr std::array<std::array<size_t, 4>, 6> faces =
+			{ {
+				{ 0, 4, 6, 2 }, { 1, 3, 7, 5 },
+				{ 0, 1, 5, 4 }, { 2, 6, 7, 3 },
+				{ 0, 2, 3, 1 }, { 4, 5, 7, 6 }
+			} };
+			const int64_t samplePadding = depthBuffer.sampleCount > 1 ? subTexelSteps / 2 : 0;
+			PipelineStatistics setupStatistics;
+			std::vector<SetupTriangle<NoAttributes>> setupTriangles;
+			for (const std::array<size_t, 4> &face : faces)
+			for (size_t i = 1; i < 3; i++)
+			{
+				const Triangle triangle = { .vertices = { corners[face[0]], corners[face[i]], corners[face[i + 1]] } };
+				if (auto setup = setupTriangle<NoAttributes>(triangle, {}, depthBuffer.width, depthBuffer.height, samplePadding, setupStatistics))
+				{
+					setupTriangles.push_back(*setup);
+				}
+			}
+			if (setupTriangles.empty()) return 0;
+
+			//the few triangles are tested against every tile, a row of tiles per job
+			const size_t tileColumns = (depthBuffer.width + tileSize - 1) / tileSize;
+			const size_t tileRows = (depthBuffer.height + tileSize - 1) / tileSize;
+			std::vector<uint64_t> passedSamples(tileRows);
+			JobSystem::parallelFor(tileRows, 1, [&](size_t begin, size_t end)
+			{
+				//queries aren't draws, their counters are dropped
+				PipelineStatistics statistics;
+				for (size_t row = begin; row < end; row++)
+				for (size_t column = 0; column < tileColumns; column++)
+				{
+					const size_t tileMinX = column * tileSize;
+					const size_t tileMinY = row * tileSize;
+					for (const SetupTriangle<NoAttributes> &setup : setupTriangles)
+					{
+						if (setup.maxX < tileMinX || setup.minX >= tileMinX + tileSize || setup.maxY < tileMinY || setup.minY >= tileMinY + tileSize) continue;
+
+						passedSamples[row] += rasterizeTriangle(setup, tileMinX, tileMinY, drawInfo, statistics);
+					}
+				}
+			});
+			return std::accumulate(passedSamples.begin(), passedSamples.end(), uint64_t(0));
+		}
+
+		//queries the bounds the model was uploaded with, a model that isn't found having no sample passing
+		[[nodiscard]]
+		static uint64_t queryOcclusion(ModelHandle handle, const mat4x4 &modelViewProjection, FrameBuffer<float> &depthBuffer)
+		{
+			const std::optional<AABB3> bounds = boundsOf(handle);
+			return bounds.has_value() ? queryOcclusion(*bounds, modelViewProjection, depthBuffer) : 0;
+		}
+
 		template<typename RenderTarget_t, Shader Vertex_t, Shader Fragment_t, Attributes Attributes_t>
-		static void drawTriangles(ModelHandle handle, DrawInfo<RenderTarget_t, Vertex_t, Fragment_t, Attributes_t> &drawInfo)
+		static DrawResult drawTriangles(ModelHandle handle, DrawInfo<RenderTarget_t, Vertex_t, Fragment_t, Attributes_t> &drawInfo)
 		{
+			PROFILE_ZONE("drawTriangles");
 			if (const auto found = models.find(handle);
 				found != models.end())
 			{
-				const mat4x4 viewportMat = mat4x4::viewport({
-					.x = 0,
-					.y = 0,
-					.width = drawInfo.target.width,
-					.height = drawInfo.target.height,
-					});
+				const UploadedModel &model = (*found).second;
 
-				const Model &model = (*found).second;
-				for (const auto &triangle : model.get())
+				std::optional<culling::Frustum> frustum;
+				std::optional<culling::ViewPoint> viewPoint;
+				if (drawInfo.modelViewProjection.has_value())
 				{
-					drawTriangle(triangle, viewportMat, drawInfo);
+					frustum = culling::Frustum::fromMatrix(*drawInfo.modelViewProjection);
+					if (isCulled(model, *frustum))
+					{
+						return DrawResult::Culled;
+					}
+					viewPoint = culling::ViewPoint::fromMatrix(*drawInfo.modelViewProjection);
 				}
+
+				const mat4x4 viewportMat = calculateViewportMat(drawInfo);
+				drawModel(model, viewportMat, frustum, viewPoint, drawInfo, drawInfo.vertexShader, drawInfo.instanceId);
+
+				return DrawResult::Drawn;
 			}
+
+			return DrawResult::ModelNotFound;
 		};
 
-	private:
+		//draws the model once per instance, the vertex shader being called with the vertex and its instance
+		//the model lookup and viewport setup are done once for all instances, culling once per instance
+		//returns how many instances weren't culled
+		template<typename RenderTarget_t, Shader Vertex_t, Shader Fragment_t, Attributes Attributes_t, typename Payload_t>
+		static size_t drawTrianglesInstanced(ModelHandle handle, std::span<const Instance<Payload_t>> instances, DrawInfo<RenderTarget_t, Vertex_t, Fragment_t, Attributes_t> &drawInfo, bool parallelCulling = false)
+		{
+			PROFILE_ZONE("drawTrianglesInstanced");
+			const auto found = models.find(handle);
+			if (found == models.end()) return 0;
 
-		inline static std::unordered_map<ModelHandle, Model> models;
+			const UploadedModel &model = (*found).second;
+			const mat4x4 viewportMat = calculateViewportMat(drawInfo);
+
+			struct InstanceCulling
+			{
+				bool visible = true;
+				std::optional<culling::Frustum> frustum;
+				std::optional<culling::ViewPoint> viewPoint;
+			};
 
+			std::vector<InstanceCulling> instanceCulling(instances.size());
+			if (drawInfo.modelViewProjection.has_value())
+			{
+				auto cullInstance = [&model, &drawInfo](const Instance<Payload_t> &instance)
+				{
+					const mat4x4 modelViewProjection = *drawInfo.modelViewProjection * instance.transform;
+					InstanceCulling result = { .frustum = culling::Frustum::fromMatrix(modelViewProjection) };
+					result.visible = !isCulled(model, *result.frustum);
+					if (result.visible)
+					{
+						result.viewPoint = culling::ViewPoint::fromMatrix(modelViewProjection);
+					}
+					return result;
+				};
+
+				constexpr size_t instancesPerJob = 64;
+				JobSystem::parallelFor(instances.size(), parallelCulling ? instancesPerJob : instances.size(), [&](size_t begin, size_t end)
+				{
+					std::transform(instances.begin() + begin, instances.begin() + end, instanceCulling.begin() + begin, cullInstance);
+				});
+			}
+
+			size_t drawnInstances = 0;
+			for (size_t i = 0; i < instances.size(); i++)
+			{
+				const InstanceCulling &cullingResult = instanceCulling[i];
+				if (!cullingResult.visible) continue;
+
+				const Instance<Payload_t> &instance = instances[i];
+				auto instanceVertexShader = [&drawInfo, &instance](const Triangle::Vertex &vertex)
+				{
+					return drawInfo.vertexShader(vertex, instance);
+				};
+
+				drawModel(model, viewportMat, cullingResult.frustum, cullingResult.viewPoint, drawInfo, instanceVertexShader, drawInfo.instanceId + static_cast<uint32_t>(i));
+				drawnInstances++;
+			}
+
+			return drawnInstances;
+		}
+
+		//shades the samples of the visibility buffer drawn with drawInfo.instanceId, once per texel and triangle whatever the overdraw was
+		//the vertex shader has to be the one the model was drawn to the visibility buffer with, it's run again for the triangles being shaded
 		template<typename RenderTarget_t, Shader Vertex_t, Shader Fragment_t, Attributes Attributes_t>
-		static void rasterize(int x, int y, Triangle& triangle, const std::array<Attributes_t, 3>&attributes, DrawInfo<RenderTarget_t, Vertex_t, Fragment_t, Attributes_t> &drawInfo)
+		static DrawResult shadeVisibility(ModelHandle handle, const FrameBuffer<VisibilitySample> &visibility, DrawInfo<RenderTarget_t, Vertex_t, Fragment_t, Attributes_t> &drawInfo)
 		{
-			const std::array<float, 3> vertexWs{ triangle.vertices[0].position.w(), triangle.vertices[1].position.w(), triangle.vertices[2].position.w(), };
+			PROFILE_ZONE("shadeVisibility");
+			const auto found = models.find(handle);
+			if (found == models.end()) return DrawResult::ModelNotFound;
+
+			auto instanceVertexShader = [&drawInfo](const Triangle::Vertex &vertex, size_t)
+			{
+				return drawInfo.vertexShader(vertex);
+			};
+			shadeModelVisibility((*found).second, visibility, drawInfo, 1, instanceVertexShader);
+			return DrawResult::Drawn;
+		}
+
+		//shades the samples of the visibility buffer drawn by drawTrianglesInstanced with the same instances
+		template<typename RenderTarget_t, Shader Vertex_t, Shader Fragment_t, Attributes Attributes_t, typename Payload_t>
+		static DrawResult shadeVisibilityInstanced(ModelHandle handle, std::span<const Instance<Payload_t>> instances, const FrameBuffer<VisibilitySample> &visibility, DrawInfo<RenderTarget_t, Vertex_t, Fragment_t, Attributes_t> &drawInfo)
+		{
+			const auto found = models.find(handle);
+			if (found == models.end()) return DrawResult::ModelNotFound;
+
+			auto instanceVertexShader = [&drawInfo, &instances](const Triangle::Vertex &vertex, size_t instance)
+			{
+				return drawInfo.vertexShader(vertex, instances[instance]);
+			};
+			shadeModelVisibility((*found).second, visibility, drawInfo, instances.size(), instanceVertexShader);
+			return DrawResult::Drawn;
+		}
+
+	private:
+
+		struct UploadedModel
+		{
+			IndexedMesh mesh;
+			MeshletMesh meshlets;
+			AABB3 bounds;
+			culling::Sphere boundingSphere;
+		};
+
+		static bool isCulled(const UploadedModel &model, const culling::Frustum &frustum)
+		{
+			//the sphere is cheaper to test, the box is tighter
+			return !frustum.intersects(model.boundingSphere) || !frustum.intersects(model.bounds);
+		}
 
-			const auto barycentricCoords =
-				triangle.calculate2DBarycentricCoords(
-					vec2(static_cast<float>(x), static_cast<float>(y)),
-					vertexWs);
+		inline static std::unordered_map<ModelHandle, UploadedModel> models;
 
-			//if we're inside the triangle, draw it
-			if (barycentricCoords.areDegenerate()) return;
+		//occlusion queries only rasterize positions
+		struct NoAttributes
+		{
+			static NoAttributes barycentricInterpolation(Triangle::BarycentricCoordinates, NoAttributes, NoAttributes, NoAttributes)
+			{
+				return {};
+			}
+		};
+
+		//vertices are snapped to 1/256th of a texel, which edge functions are then evaluated in
+		static constexpr int64_t subTexelBits = 8;
+		static constexpr int64_t subTexelSteps = 1 << subTexelBits;
+		//vertices further away than this many texels couldn't be snapped without the edge functions overflowing
+		static constexpr float guardBand = static_cast<float>(1 << 22);
 
-			const vec4 pos = barycentricCoords.weigh(
-				triangle.vertices[0].position,
-				triangle.vertices[1].position,
-				triangle.vertices[2].position
+		//a * x + b * y + c, positive on the inner side of the edge, x and y being in sub-texels
+		struct EdgeFunction
+		{
+			int64_t a, b, c;
+			//a sample right on an edge only belongs to the triangle if it's a top or left edge,
+			//so that exactly one of two triangles sharing the edge covers it
+			int64_t bias;
+
+			[[nodiscard]]
+			int64_t evaluate(int64_t x, int64_t y) const
+			{
+				return a * x + b * y + c;
+			}
+		};
+
+		//a front facing triangle that covers at least one texel of the target
+		template<Attributes Attributes_t>
+		struct SetupTriangle
+		{
+			Triangle triangle;
+			std::array<Attributes_t, 3> attributes;
+			//the edge facing each vertex
+			std::array<EdgeFunction, 3> edges = {};
+			//twice the triangle's area, in square sub-texels
+			int64_t doubleArea = 0;
+			//texels whose sample point is within the triangle's snapped bounds, clamped to the target
+			size_t minX = 0, minY = 0, maxX = 0, maxY = 0;
+			//for small triangles, the covered texels of the footprint starting at minX, minY
+			//bit x + y * smallTriangleSize is set when texel minX + x, minY + y is covered, 0 for other triangles
+			//on multisampled targets, it's set when any of the texel's samples can be, which are then tested one by one
+			uint16_t coverageMask = 0;
+			//what visibility buffers are written
+			uint32_t triangleId = 0;
+			uint32_t instanceId = 0;
+		};
+
+		//triangles whose bounds fit in this many texels on each side have their coverage found once at setup
+		static constexpr int64_t smallTriangleSize = 4;
+
+		static constexpr size_t tileSize = 64;
+		//larger triangles are walked in blocks of this many texels on each side, aligned to the tiles
+		static constexpr size_t blockSize = 8;
+		static_assert(tileSize % blockSize == 0);
+		static constexpr size_t meshletsPerJob = 4;
+		static constexpr size_t minTrianglesPerParallelDraw = 256;
+		static constexpr size_t visibilityRowsPerJob = 8;
+		//shaded triangles kept by each visibility job, indexed by their id
+		static constexpr size_t visibilityTriangleCacheSize = 256;
+
+		template<typename RenderTarget_t, Shader Vertex_t, Shader Fragment_t, Attributes Attributes_t>
+		static RenderTarget_t shadeFragment(const Triangle::BarycentricCoordinates &barycentricCoords, const Triangle &triangle, const std::array<Attributes_t, 3> &attributes, DrawInfo<RenderTarget_t, Vertex_t, Fragment_t, Attributes_t> &drawInfo)
+		{
+			const Triangle::Vertex weighedVertex = Triangle::Vertex::barycentricInterpolation(
+				barycentricCoords,
+				triangle.vertices[0],
+				triangle.vertices[1],
+				triangle.vertices[2]
 			);
-		
-			auto depthTest = [&drawInfo, x, y](float z)
+
+			const Attributes_t weighedAttributes = Attributes_t::barycentricInterpolation(
+				barycentricCoords,
+				attributes[0],
+				attributes[1],
+				attributes[2]
+			);
+
+			return drawInfo.fragmentShader(weighedVertex, weighedAttributes);
+		}
+
+		template<typename RenderTarget_t, Shader Vertex_t, Shader Fragment_t, Attributes Attributes_t>
+		static mat4x4 calculateViewportMat(const DrawInfo<RenderTarget_t, Vertex_t, Fragment_t, Attributes_t> &drawInfo)
+		{
+			return mat4x4::viewport({
+				.x = 0,
+				.y = 0,
+				.width = drawInfo.target.width,
+				.height = drawInfo.target.height,
+				});
+		}
+
+		//the model goes through three stages, each split into jobs :
+		//vertex : meshlets are culled, shaded and their triangles set up, a few meshlets per job
+		//binning : triangles are sorted into the screen tiles they touch, a row of tiles per job
+		//raster : each tile draws its triangles in submission order, so the result doesn't depend on scheduling
+		template<typename RenderTarget_t, Shader Vertex_t, Shader Fragment_t, Attributes Attributes_t, typename VertexShader_t>
+		static void drawModel(const UploadedModel &model, const mat4x4 &viewportMat, const std::optional<culling::Frustum> &frustum, const std::optional<culling::ViewPoint> &viewPoint, DrawInfo<RenderTarget_t, Vertex_t, Fragment_t, Attributes_t> &drawInfo, VertexShader_t &vertexShader, uint32_t instanceId)
+		{
+			const IndexedMesh &mesh = model.mesh;
+			const MeshletMesh &meshlets = model.meshlets;
+			const size_t meshletCount = meshlets.meshlets.size();
+
+			assert(drawInfo.depthBuffer == nullptr || drawInfo.depthBuffer->sampleCount == drawInfo.target.sampleCount);
+
+			//samples can be up to half a texel away from the texel's sample point
+			const int64_t samplePadding = drawInfo.target.sampleCount > 1 ? subTexelSteps / 2 : 0;
+
+			std::vector<std::vector<SetupTriangle<Attributes_t>>> setupTriangles((meshletCount + meshletsPerJob - 1) / meshletsPerJob);
+			//one per job, added to the draw's once they're all done
+			std::vector<PipelineStatistics> vertexStatistics(pipelineStatisticsEnabled ? setupTriangles.size() : 0);
 			{
-				if (drawInfo.depthBuffer != nullptr)
+				PROFILE_ZONE("vertex stage");
+				JobSystem::parallelFor(meshletCount, meshletsPerJob, [&](size_t begin, size_t end)
 				{
-					float &depth = drawInfo.depthBuffer->atTexel(x, y);
-					if (depth <= z)
+					std::vector<SetupTriangle<Attributes_t>> &output = setupTriangles[begin / meshletsPerJob];
+					PipelineStatistics statistics;
+					for (size_t meshletIndex = begin; meshletIndex < end; meshletIndex++)
 					{
-						return false;
+						const Meshlet &meshlet = meshlets.meshlets[meshletIndex];
+						if (frustum.has_value() &&
+							(!frustum->intersects(meshlet.bounds) || viewPoint->isBackfacing(meshlet.cone, meshlet.bounds)))
+						{
+							PipelineStatistics::count(statistics.meshletCulledTriangles, meshlet.triangleCount);
+							continue;
+						}
+
+						//every vertex of the meshlet is shaded exactly once, triangles then only gather the results
+						std::array<VertexReturn<Attributes_t>, Meshlet::maxVertices> shadedVertices;
+						for (uint32_t i = 0; i < meshlet.vertexCount; i++)
+						{
+							const uint32_t vertexIndex = meshlets.vertexIndices[meshlet.vertexOffset + i];
+							shadedVertices[i] = shadeVertex<Attributes_t>(mesh.vertices[vertexIndex], viewportMat, vertexShader);
+						}
+						PipelineStatistics::count(statistics.verticesShaded, meshlet.vertexCount);
+
+						const uint8_t *localIndices = &meshlets.localIndices[meshlet.triangleOffset * 3];
+						for (uint32_t i = 0; i < meshlet.triangleCount * 3; i += 3)
+						{
+							const VertexReturn<Attributes_t> &a = shadedVertices[localIndices[i]];
+							const VertexReturn<Attributes_t> &b = shadedVertices[localIndices[i + 1]];
+							const VertexReturn<Attributes_t> &c = shadedVertices[localIndices[i + 2]];
+							if (auto setup = setupTriangle<Attributes_t>(Triangle{ .vertices = { a.vertex, b.vertex, c.vertex } }, { a.attributes, b.attributes, c.attributes }, drawInfo.target.width, drawInfo.target.height, samplePadding, statistics))
+							{
+								setup->triangleId = static_cast<uint32_t>(meshletIndex * Meshlet::maxTriangles + i / 3);
+								setup->instanceId = instanceId;
+								output.push_back(*setup);
+							}
+						}
 					}
-					depth = z;
-				}
-				return true;
-			};
-			
-			if (depthTest(pos.z()))
+
+					if constexpr (pipelineStatisticsEnabled)
+					{
+						vertexStatistics[begin / meshletsPerJob] = statistics;
+					}
+				});
+			}
+			addStatistics(drawInfo, vertexStatistics);
+
+			size_t triangleCount = 0;
+			for (const auto &output : setupTriangles)
 			{
-				const Triangle::Vertex weighedVertex = Triangle::Vertex::barycentricInterpolation(
-					barycentricCoords,
-					triangle.vertices[0],
-					triangle.vertices[1],
-					triangle.vertices[2]
-				);
+				triangleCount += output.size();
+			}
+			if (triangleCount == 0) return;
+
+			const size_t tileColumns = (drawInfo.target.width + tileSize - 1) / tileSize;
+			const size_t tileRows = (drawInfo.target.height + tileSize - 1) / tileSize;
+			//small draws aren't worth the scheduling
+			const size_t grainSize = triangleCount < minTrianglesPerParallelDraw ? tileColumns * tileRows : 1;
 
-				const Attributes_t weighedAttributes = Attributes_t::barycentricInterpolation(
-					barycentricCoords,
-					attributes[0],
-					attributes[1],
-					attributes[2]
-				);
+			std::vector<std::vector<const SetupTriangle<Attributes_t> *>> bins(tileColumns * tileRows);
+			{
+				PROFILE_ZONE("binning stage");
+				JobSystem::parallelFor(tileRows, grainSize, [&](size_t begin, size_t end)
+				{
+					for (size_t row = begin; row < end; row++)
+					{
+						const size_t rowMinY = row * tileSize;
+						const size_t rowMaxY = rowMinY + tileSize - 1;
+						for (const auto &output : setupTriangles)
+						for (const SetupTriangle<Attributes_t> &setup : output)
+						{
+							if (setup.maxY < rowMinY || setup.minY > rowMaxY) continue;
 
-				drawInfo.target.atTexel(x, y) = drawInfo.fragmentShader(weighedVertex, weighedAttributes);
+							for (size_t column = setup.minX / tileSize; column <= setup.maxX / tileSize; column++)
+							{
+								bins[row * tileColumns + column].push_back(&setup);
+							}
+						}
+					}
+				});
 			}
+
+			PROFILE_ZONE("raster stage");
+			std::vector<PipelineStatistics> rasterStatistics(pipelineStatisticsEnabled ? (bins.size() + grainSize - 1) / grainSize : 0);
+			JobSystem::parallelFor(bins.size(), grainSize, [&](size_t begin, size_t end)
+			{
+				PipelineStatistics statistics;
+				for (size_t tile = begin; tile < end; tile++)
+				{
+					TRACE_ZONE("tile");
+					const size_t tileMinX = (tile % tileColumns) * tileSize;
+					const size_t tileMinY = (tile / tileColumns) * tileSize;
+					for (const SetupTriangle<Attributes_t> *setup : bins[tile])
+					{
+						rasterizeTriangle(*setup, tileMinX, tileMinY, drawInfo, statistics);
+					}
+				}
+
+				if constexpr (pipelineStatisticsEnabled)
+				{
+					rasterStatistics[begin / grainSize] = statistics;
+				}
+			});
+			addStatistics(drawInfo, rasterStatistics);
 		}
 
 		template<typename RenderTarget_t, Shader Vertex_t, Shader Fragment_t, Attributes Attributes_t>
-		static void drawTriangle(Triangle triangle, const mat4x4& viewportMat, DrawInfo<RenderTarget_t, Vertex_t, Fragment_t, Attributes_t> &drawInfo)
+		static void addStatistics(DrawInfo<RenderTarget_t, Vertex_t, Fragment_t, Attributes_t> &drawInfo, const std::vector<PipelineStatistics> &jobStatistics)
 		{
-			//vertex shader
-			std::array<Attributes_t, 3> attributesArray = {};
-			for(size_t i = 0; i < 3; i++)
+			if (drawInfo.statistics == nullptr) return;
+
+			for (const PipelineStatistics &statistics : jobStatistics)
 			{
-				Triangle::Vertex &vertex = triangle.vertices[i];
-				const VertexReturn result = drawInfo.vertexShader(vertex);
-				attributesArray[i] = result.attributes;
-				vertex = result.vertex;
-				vec4 &position = vertex.position;
-				position = viewportMat * position;
-				if (!isApproximatively(position.w(), .0f, .001f)) 
-				{ 
-					position /= position.w();
+				*drawInfo.statistics += statistics;
+			}
+		}
+
+		template<Attributes Attributes_t, typename VertexShader_t>
+		static VertexReturn<Attributes_t> shadeVertex(const Triangle::Vertex &vertex, const mat4x4 &viewportMat, VertexShader_t &vertexShader)
+		{
+			VertexReturn<Attributes_t> result = vertexShader(vertex);
+			vec4 &position = result.vertex.position;
+			position = viewportMat * position;
+			if (!isApproximatively(position.w(), .0f, .001f)) 
+			{ 
+				position /= position.w();
+			};
+			return result;
+		}
+
+		//instanceVertexShader(vertex, instance) shades the vertex for the instance drawn with drawInfo.instanceId + instance
+		template<typename RenderTarget_t, Shader Vertex_t, Shader Fragment_t, Attributes Attributes_t, typename InstanceVertexShader_t>
+		static void shadeModelVisibility(const UploadedModel &model, const FrameBuffer<VisibilitySample> &visibility, DrawInfo<RenderTarget_t, Vertex_t, Fragment_t, Attributes_t> &drawInfo, size_t instanceCount, InstanceVertexShader_t &instanceVertexShader)
+		{
+			static_assert(!usesFragmentQuads<Fragment_t, Attributes_t>, "visibility buffers are shaded texel by texel, there are no quads to take derivatives from");
+			assert(visibility.width == drawInfo.target.width && visibility.height == drawInfo.target.height && visibility.sampleCount == drawInfo.target.sampleCount);
+
+			const mat4x4 viewportMat = calculateViewportMat(drawInfo);
+			const uint32_t sampleCount = visibility.sampleCount;
+
+			std::vector<PipelineStatistics> rowStatistics(pipelineStatisticsEnabled ? (visibility.height + visibilityRowsPerJob - 1) / visibilityRowsPerJob : 0);
+			JobSystem::parallelFor(visibility.height, visibilityRowsPerJob, [&](size_t beginRow, size_t endRow)
+			{
+				PipelineStatistics statistics;
+				//neighbouring texels are likely to be covered by the same few triangles, whose vertices are only shaded again once evicted
+				struct ShadedTriangle
+				{
+					uint32_t triangleId = VisibilitySample::noTriangle;
+					uint32_t instanceId = 0;
+					Triangle triangle = {};
+					std::array<Attributes_t, 3> attributes = {};
 				};
+				std::vector<ShadedTriangle> shadedTriangles(visibilityTriangleCacheSize);
+
+				for (size_t y = beginRow; y < endRow; y++)
+				for (size_t x = 0; x < visibility.width; x++)
+				for (uint32_t sample = 0; sample < sampleCount; sample++)
+				{
+					const VisibilitySample &visibilitySample = visibility.atSample(x, y, sample);
+					const size_t instance = static_cast<size_t>(visibilitySample.instanceId - drawInfo.instanceId);
+					if (visibilitySample.triangleId == VisibilitySample::noTriangle || visibilitySample.instanceId < drawInfo.instanceId || instance >= instanceCount) continue;
+
+					//samples of the texel covered by the same triangle share its color
+					const uint32_t previousSample = findSameFragment(visibility, x, y, sample);
+					if (previousSample != sample)
+					{
+						drawInfo.target.atSample(x, y, sample) = drawInfo.target.atSample(x, y, previousSample);
+						continue;
+					}
+
+					ShadedTriangle &shaded = shadedTriangles[visibilitySample.triangleId % visibilityTriangleCacheSize];
+					if (shaded.triangleId != visibilitySample.triangleId || shaded.instanceId != visibilitySample.instanceId)
+					{
+						auto vertexShader = [&instanceVertexShader, instance](const Triangle::Vertex &vertex) { return instanceVertexShader(vertex, instance); };
+						const Meshlet &meshlet = model.meshlets.meshlets[visibilitySample.triangleId / Meshlet::maxTriangles];
+						const uint8_t *localIndices = &model.meshlets.localIndices[(meshlet.triangleOffset + visibilitySample.triangleId % Meshlet::maxTriangles) * 3];
+						for (size_t i = 0; i < 3; i++)
+						{
+							const uint32_t vertexIndex = model.meshlets.vertexIndices[meshlet.vertexOffset + localIndices[i]];
+							const VertexReturn<Attributes_t> shadedVertex = shadeVertex<Attributes_t>(model.mesh.vertices[vertexIndex], viewportMat, vertexShader);
+							shaded.triangle.vertices[i] = shadedVertex.vertex;
+							shaded.attributes[i] = shadedVertex.attributes;
+						}
+						shaded.triangleId = visibilitySample.triangleId;
+						shaded.instanceId = visibilitySample.instanceId;
+						PipelineStatistics::count(statistics.verticesShaded, 3);
+					}
+
+					const std::array<float, 2> &weights = visibilitySample.barycentrics;
+					const auto barycentricCoords = Triangle::BarycentricCoordinates::fromWeights(vec3(1.0f - weights[0] - weights[1], weights[0], weights[1]), { 1.0f, 1.0f, 1.0f });
+					drawInfo.target.atSample(x, y, sample) = shadeFragment(barycentricCoords, shaded.triangle, shaded.attributes, drawInfo);
+					PipelineStatistics::count(statistics.fragmentShaderInvocations);
+				}
+
+				if constexpr (pipelineStatisticsEnabled)
+				{
+					rowStatistics[beginRow / visibilityRowsPerJob] = statistics;
+				}
+			});
+			addStatistics(drawInfo, rowStatistics);
+		}
+
+		//the first sample of the texel covered by the same triangle of the same instance
+		static uint32_t findSameFragment(const FrameBuffer<VisibilitySample> &visibility, size_t x, size_t y, uint32_t sample)
+		{
+			const VisibilitySample &visibilitySample = visibility.atSample(x, y, sample);
+			for (uint32_t previousSample = 0; previousSample < sample; previousSample++)
+			{
+				const VisibilitySample &previous = visibility.atSample(x, y, previousSample);
+				if (previous.triangleId == visibilitySample.triangleId && previous.instanceId == visibilitySample.instanceId)
+				{
+					return previousSample;
+				}
+			}
+			return sample;
+		}
+
+		//rounds towards negative infinity, unlike the division operator
+		static int64_t floorDivide(int64_t numerator, int64_t denominator)
+		{
+			return numerator >= 0 ? numerator / denominator : -((-numerator + denominator - 1) / denominator);
+		}
+
+		template<Attributes Attributes_t>
+		static std::optional<SetupTriangle<Attributes_t>> setupTriangle(const Triangle &triangle, const std::array<Attributes_t, 3> &attributesArray, size_t width, size_t height, int64_t samplePadding, PipelineStatistics &statistics)
+		{
+			std::array<int64_t, 3> xs = {}, ys = {};
+			for (size_t i = 0; i < 3; i++)
+			{
+				const vec4 &position = triangle.vertices[i].position;
+				//also rejects NaNs
+				if (!(std::abs(position.x()) < guardBand && std::abs(position.y()) < guardBand))
+				{
+					PipelineStatistics::count(statistics.offscreenTriangles);
+					return std::nullopt;
+				}
+				xs[i] = std::llround(position.x() * static_cast<float>(subTexelSteps));
+				ys[i] = std::llround(position.y() * static_cast<float>(subTexelSteps));
 			}
 
-			//backface culling
-			if (vec3::dot(triangle.calculateFaceNormal(), vec3(.0f, .0f, 1.0f)) < 0)
+			SetupTriangle<Attributes_t> setup = { .triangle = triangle, .attributes = attributesArray };
+			for (size_t i = 0; i < 3; i++)
+			{
+				const size_t from = (i + 1) % 3;
+				const size_t to = (i + 2) % 3;
+				EdgeFunction &edge = setup.edges[i];
+				edge.a = ys[from] - ys[to];
+				edge.b = xs[to] - xs[from];
+				edge.c = -(edge.a * xs[from] + edge.b * ys[from]);
+
+				//front faces go counter clockwise with y going up, so left edges go down and top edges go left
+				const bool isTopLeft = edge.a > 0 || (edge.a == 0 && edge.b < 0);
+				edge.bias = isTopLeft ? 0 : -1;
+			}
+
+			//backface culling, degenerate triangles don't cover anything either
+			setup.doubleArea = setup.edges[2].evaluate(xs[2], ys[2]);
+			if (setup.doubleArea <= 0)
+			{
+				PipelineStatistics::count(setup.doubleArea < 0 ? statistics.backfacingTriangles : statistics.degenerateTriangles);
+				return std::nullopt;
+			}
+
+			//texel x's sample point is at x + .5
+			auto firstTexel = [samplePadding](int64_t minimum)
+			{
+				return floorDivide(minimum - samplePadding - subTexelSteps / 2 + subTexelSteps - 1, subTexelSteps);
+			};
+			auto lastTexel = [samplePadding](int64_t maximum)
+			{
+				return floorDivide(maximum + samplePadding - subTexelSteps / 2, subTexelSteps);
+			};
+
+			const int64_t firstX = firstTexel(std::min({ xs[0], xs[1], xs[2] }));
+			const int64_t firstY = firstTexel(std::min({ ys[0], ys[1], ys[2] }));
+			const int64_t lastX = lastTexel(std::max({ xs[0], xs[1], xs[2] }));
+			const int64_t lastY = lastTexel(std::max({ ys[0], ys[1], ys[2] }));
+			const int64_t minX = std::max<int64_t>(firstX, 0);
+			const int64_t minY = std::max<int64_t>(firstY, 0);
+			const int64_t maxX = std::min<int64_t>(lastX, static_cast<int64_t>(width) - 1);
+			const int64_t maxY = std::min<int64_t>(lastY, static_cast<int64_t>(height) - 1);
+
+			if (minX > maxX || minY > maxY)
+			{
+				//triangle is outside of the bounds of the screen or between sample points
+				const bool isOffscreen = lastX < 0 || lastY < 0 || firstX >= static_cast<int64_t>(width) || firstY >= static_cast<int64_t>(height);
+				PipelineStatistics::count(isOffscreen ? statistics.offscreenTriangles : statistics.degenerateTriangles);
+				return std::nullopt;
+			}
+
+			setup.minX = static_cast<size_t>(minX);
+			setup.minY = static_cast<size_t>(minY);
+			setup.maxX = static_cast<size_t>(maxX);
+			setup.maxY = static_cast<size_t>(maxY);
+
+			//dense meshes are mostly made of these, testing the whole footprint without branching is cheaper than walking the bounds
+			//multisampled texels are tested as a whole, their samples lying within half a texel of the sample point
+			if (maxX - minX < smallTriangleSize && maxY - minY < smallTriangleSize)
+			{
+				std::array<int64_t, 3> paddings = {};
+				for (size_t i = 0; i < 3; i++)
+				{
+					paddings[i] = setup.edges[i].bias + (std::abs(setup.edges[i].a) + std::abs(setup.edges[i].b)) * samplePadding;
+				}
+
+				uint32_t coverageMask = 0;
+				for (int64_t y = 0; y < smallTriangleSize; y++)
+				for (int64_t x = 0; x < smallTriangleSize; x++)
+				{
+					const int64_t sampleX = (minX + x) * subTexelSteps + subTexelSteps / 2;
+					const int64_t sampleY = (minY + y) * subTexelSteps + subTexelSteps / 2;
+					const bool isCovered =
+						(x <= maxX - minX) & (y <= maxY - minY) &
+						(setup.edges[0].evaluate(sampleX, sampleY) + paddings[0] >= 0) &
+						(setup.edges[1].evaluate(sampleX, sampleY) + paddings[1] >= 0) &
+						(setup.edges[2].evaluate(sampleX, sampleY) + paddings[2] >= 0);
+					coverageMask |= static_cast<uint32_t>(isCovered) << (x + y * smallTriangleSize);
+				}
+
+				if (coverageMask == 0)
+				{
+					//falls between sample points, the footprint holding all of the covered ones
+					PipelineStatistics::count(statistics.degenerateTriangles);
+					return std::nullopt;
+				}
+				setup.coverageMask = static_cast<uint16_t>(coverageMask);
+			}
+
+			PipelineStatistics::count(statistics.rasterizedTriangles);
+			return setup;
+		}
+
+		//only touches the texels of the tile starting at tileMinX, tileMinY
+		//edge functions are evaluated once per row and stepped from one texel to the next
+		//returns how many samples passed the depth test, only counted for occlusion queries
+		template<typename RenderTarget_t, Shader Vertex_t, Shader Fragment_t, Attributes Attributes_t>
+		static uint64_t rasterizeTriangle(const SetupTriangle<Attributes_t> &setup, size_t tileMinX, size_t tileMinY, DrawInfo<RenderTarget_t, Vertex_t, Fragment_t, Attributes_t> &drawInfo, PipelineStatistics &statistics)
+		{
+			const size_t minX = std::max(setup.minX, tileMinX);
+			const size_t minY = std::max(setup.minY, tileMinY);
+			const size_t maxX = std::min(setup.maxX, tileMinX + tileSize - 1);
+			const size_t maxY = std::min(setup.maxY, tileMinY + tileSize - 1);
+
+			const Triangle &triangle = setup.triangle;
+			const std::array<EdgeFunction, 3> &edges = setup.edges;
+			const std::array<float, 3> vertexWs{ triangle.vertices[0].position.w(), triangle.vertices[1].position.w(), triangle.vertices[2].position.w(), };
+			const float inverseDoubleArea = 1.0f / static_cast<float>(setup.doubleArea);
+			const bool isMultisampled = drawInfo.target.sampleCount > 1;
+			//only the shading path matching the fragment shader's signature is compiled
+			constexpr bool isQuadShaded = usesFragmentQuads<Fragment_t, Attributes_t>;
+			//visibility buffers get what identifies the fragment instead of its shaded color
+			constexpr bool isVisibilityPass = std::is_same_v<RenderTarget_t, VisibilitySample>;
+			constexpr bool isDepthOnly = std::is_same_v<Fragment_t, DepthOnly>;
+			constexpr bool isOcclusionQuery = std::is_same_v<Fragment_t, OcclusionQuery>;
+			constexpr bool isUnorm16DepthOnly = isDepthOnly && std::is_same_v<RenderTarget_t, uint16_t>;
+			uint64_t passedSamples = 0;
+
+			auto isInside = [&edges](const std::array<int64_t, 3> &edgeValues)
+			{
+				return edgeValues[0] + edges[0].bias >= 0 && edgeValues[1] + edges[1].bias >= 0 && edgeValues[2] + edges[2].bias >= 0;
+			};
+
+			auto evaluateEdges = [&edges](size_t x, size_t y) -> std::array<int64_t, 3>
+			{
+				const int64_t sampleX = static_cast<int64_t>(x) * subTexelSteps + subTexelSteps / 2;
+				const int64_t sampleY = static_cast<int64_t>(y) * subTexelSteps + subTexelSteps / 2;
+				return { edges[0].evaluate(sampleX, sampleY), edges[1].evaluate(sampleX, sampleY), edges[2].evaluate(sampleX, sampleY) };
+			};
+
+			auto calculateBarycentricCoords = [&](const std::array<int64_t, 3> &edgeValues)
+			{
+				const vec3 weights = vec3(static_cast<float>(edgeValues[0]), static_cast<float>(edgeValues[1]), static_cast<float>(edgeValues[2])) * inverseDoubleArea;
+				return Triangle::BarycentricCoordinates::fromWeights(weights, vertexWs);
+			};
+
+			auto calculateDepth = [&triangle](const Triangle::BarycentricCoordinates &barycentricCoords)
+			{
+				return barycentricCoords.weigh(triangle.vertices[0].position.z(), triangle.vertices[1].position.z(), triangle.vertices[2].position.z());
+			};
+
+			auto depthTest = [&drawInfo, &statistics](size_t x, size_t y, uint32_t sample, float z)
 			{
-				return;
+				PipelineStatistics::count(statistics.samplesTested);
+				if constexpr (isUnorm16DepthOnly)
+				{
+					uint16_t &depth = drawInfo.target.atSample(x, y, sample);
+					const uint16_t encoded = encodeUnorm16Depth(z);
+					if (depth <= encoded)
+					{
+						PipelineStatistics::count(statistics.depthTestFails);
+						return false;
+					}
+					depth = encoded;
+					PipelineStatistics::count(statistics.depthTestPasses);
+				}
+				else if (drawInfo.depthBuffer != nullptr)
+				{
+					float &depth = drawInfo.depthBuffer->atSample(x, y, sample);
+					if (depth <= z)
+					{
+						PipelineStatistics::count(statistics.depthTestFails);
+						return false;
+					}
+					if constexpr (!isOcclusionQuery)
+					{
+						depth = z;
+					}
+					PipelineStatistics::count(statistics.depthTestPasses);
+				}
+				return true;
+			};
+
+			//how much moving from the texel's sample point to each sample changes the edge functions
+			const std::span<const vec2> pattern = FrameBuffer<RenderTarget_t>::samplePattern(drawInfo.target.sampleCount);
+			std::array<std::array<int64_t, 3>, 8> sampleOffsets = {};
+			for (size_t sample = 0; sample < pattern.size(); sample++)
+			{
+				const int64_t offsetX = std::llround(pattern[sample].x() * static_cast<float>(subTexelSteps));
+				const int64_t offsetY = std::llround(pattern[sample].y() * static_cast<float>(subTexelSteps));
+				for (size_t i = 0; i < 3; i++)
+				{
+					sampleOffsets[sample][i] = edges[i].a * offsetX + edges[i].b * offsetY;
+				}
 			}
 
-			AABB2 imageBounds = drawInfo.target.bounds();
-			imageBounds.max.x()--;
-			imageBounds.max.y()--;
-			const AABB2 triangleAABB = triangle.calculateAABB2().boundInto(imageBounds);
+			//one bit per sample passing both the coverage and depth tests, depth being written as it passes
+			//coverage and depth are tested for every sample, but the fragment shader only runs once for the whole texel
+			auto testCoverage = [&](size_t x, size_t y, const std::array<int64_t, 3> &edgeValues, bool isFullyCovered) -> uint32_t
+			{
+				if (!isMultisampled)
+				{
+					if (!isFullyCovered && !isInside(edgeValues)) return 0;
+					return depthTest(x, y, 0, calculateDepth(calculateBarycentricCoords(edgeValues))) ? 1U : 0U;
+				}
+
+				uint32_t coverage = 0;
+				for (uint32_t sample = 0; sample < pattern.size(); sample++)
+				{
+					const std::array<int64_t, 3> sampleEdgeValues = 
+					{ 
+						edgeValues[0] + sampleOffsets[sample][0], 
+						edgeValues[1] + sampleOffsets[sample][1], 
+						edgeValues[2] + sampleOffsets[sample][2] 
+					};
+					if (!isFullyCovered && !isInside(sampleEdgeValues)) continue;
+
+					if (depthTest(x, y, sample, calculateDepth(calculateBarycentricCoords(sampleEdgeValues))))
+					{
+						coverage |= 1U << sample;
+					}
+				}
+				return coverage;
+			};
+
+			auto writeCoverage = [&](size_t x, size_t y, uint32_t coverage, const RenderTarget_t &color)
+			{
+				if (!isMultisampled)
+				{
+					drawInfo.target.atTexel(x, y) = color;
+					return;
+				}
+
+				for (uint32_t sample = 0; sample < pattern.size(); sample++)
+				{
+					if (coverage & (1U << sample))
+					{
+						drawInfo.target.atSample(x, y, sample) = color;
+					}
+				}
+			};
+
+			//shaded at the texel's sample point even when it's outside of the triangle, extrapolating the attributes
+			auto shadeTexel = [&](size_t x, size_t y, const std::array<int64_t, 3> &edgeValues, bool isFullyCovered)
+			{
+				const uint32_t coverage = testCoverage(x, y, edgeValues, isFullyCovered);
+				if (coverage == 0) return;
+
+				if constexpr (isOcclusionQuery)
+				{
+					passedSamples += static_cast<uint64_t>(std::popcount(coverage));
+				}
+				else if constexpr (isVisibilityPass)
+				{
+					const Triangle::BarycentricCoordinates barycentricCoords = calculateBarycentricCoords(edgeValues);
+					writeCoverage(x, y, coverage, VisibilitySample{ .triangleId = setup.triangleId, .instanceId = setup.instanceId, .barycentrics = { barycentricCoords[1], barycentricCoords[2] } });
+				}
+				else if constexpr (!isQuadShaded && !isDepthOnly)
+				{
+					writeCoverage(x, y, coverage, shadeFragment(calculateBarycentricCoords(edgeValues), triangle, setup.attributes, drawInfo));
+					PipelineStatistics::count(statistics.fragmentShaderInvocations);
+				}
+			};
+
+			//small triangles' lanes outside of the coverage mask aren't either
+			auto isInMask = [&setup](size_t x, size_t y)
+			{
+				if (setup.coverageMask == 0) return true;
+				const size_t bit = (x - setup.minX) + (y - setup.minY) * smallTriangleSize;
+				return ((setup.coverageMask >> bit) & 1U) != 0;
+			};
 
-			if (!triangleAABB.hasArea())
+			//quads are aligned to even texels, so they never straddle blocks or tiles
+			//lanes outside of the block can't be covered, they're only there for the derivatives
+			auto shadeQuads = [&](size_t blockMinX, size_t blockMinY, size_t blockMaxX, size_t blockMaxY, bool isFullyCovered)
 			{
-				//triangle is outside of the bounds of the screen
-				return;
-			}			
+				for (size_t quadY = blockMinY & ~size_t(1); quadY <= blockMaxY; quadY += 2)
+				for (size_t quadX = blockMinX & ~size_t(1); quadX <= blockMaxX; quadX += 2)
+				{
+					std::array<std::array<int64_t, 3>, 4> laneEdgeValues = {};
+					std::array<uint32_t, 4> laneCoverages = {};
+					uint32_t quadCoverage = 0;
+					for (size_t lane = 0; lane < 4; lane++)
+					{
+						const size_t x = quadX + lane % 2;
+						const size_t y = quadY + lane / 2;
+						laneEdgeValues[lane] = evaluateEdges(x, y);
+						if (x >= blockMinX && x <= blockMaxX && y >= blockMinY && y <= blockMaxY && isInMask(x, y))
+						{
+							laneCoverages[lane] = testCoverage(x, y, laneEdgeValues[lane], isFullyCovered);
+							quadCoverage |= laneCoverages[lane];
+						}
+					}
+
+					if (quadCoverage == 0) continue;
+
+					FragmentQuad<Attributes_t> quad = {};
+					for (size_t lane = 0; lane < 4; lane++)
+					{
+						const Triangle::BarycentricCoordinates barycentricCoords = calculateBarycentricCoords(laneEdgeValues[lane]);
+						quad.vertices[lane] = Triangle::Vertex::barycentricInterpolation(barycentricCoords, triangle.vertices[0], triangle.vertices[1], triangle.vertices[2]);
+						quad.attributes[lane] = Attributes_t::barycentricInterpolation(barycentricCoords, setup.attributes[0], setup.attributes[1], setup.attributes[2]);
+					}
 
-			for (size_t y = static_cast<size_t>(triangleAABB.min.y()); y < static_cast<size_t>(triangleAABB.max.y())+1; y++)
-			for (size_t x = static_cast<size_t>(triangleAABB.min.x()); x < static_cast<size_t>(triangleAABB.max.x())+1; x++)
+					//helper lanes aren't shaded, their inputs are enough for the derivatives
+					for (size_t lane = 0; lane < 4; lane++)
+					{
+						if (laneCoverages[lane] == 0) continue;
+
+						quad.lane = lane;
+						if constexpr (isQuadShaded)
+						{
+							writeCoverage(quadX + lane % 2, quadY + lane / 2, laneCoverages[lane], drawInfo.fragmentShader(quad.vertices[lane], quad.attributes[lane], quad));
+							PipelineStatistics::count(statistics.fragmentShaderInvocations);
+						}
+					}
+				}
+			};
+
+			if (setup.coverageMask != 0)
 			{
-				rasterize((int)x, (int)y, triangle, attributesArray, drawInfo);
+				//the mask is exact for single sampled targets, multisampled texels still have their samples tested
+				const bool isFullyCovered = !isMultisampled;
+				if constexpr (isQuadShaded)
+				{
+					//the footprint is within the tile, like blocks
+					shadeQuads(minX, minY, maxX, maxY, isFullyCovered);
+				}
+				else
+				{
+					for (uint32_t mask = setup.coverageMask; mask != 0; mask &= mask - 1)
+					{
+						const uint32_t bit = static_cast<uint32_t>(std::countr_zero(mask));
+						const size_t x = setup.minX + bit % smallTriangleSize;
+						const size_t y = setup.minY + bit / smallTriangleSize;
+						if (x < minX || x > maxX || y < minY || y > maxY) continue;
+
+						shadeTexel(x, y, evaluateEdges(x, y), isFullyCovered);
+					}
+				}
+				return passedSamples;
 			}
+
+			auto shadeBlock = [&](size_t blockMinX, size_t blockMinY, size_t blockMaxX, size_t blockMaxY, bool isFullyCovered)
+			{
+				for (size_t y = blockMinY; y <= blockMaxY; y++)
+				{
+					std::array<int64_t, 3> edgeValues = evaluateEdges(blockMinX, y);
+					for (size_t x = blockMinX; x <= blockMaxX; x++)
+					{
+						shadeTexel(x, y, edgeValues, isFullyCovered);
+
+						for (size_t i = 0; i < 3; i++)
+						{
+							edgeValues[i] += edges[i].a * subTexelSteps;
+						}
+					}
+				}
+			};
+
+			//blocks entirely outside of an edge are skipped, blocks entirely inside of all three are filled without testing coverage
+			//only the blocks crossing an edge are tested texel by texel
+			const int64_t samplePadding = isMultisampled ? subTexelSteps / 2 : 0;
+			auto nextBlockStart = [](size_t coordinate) { return (coordinate / blockSize + 1) * blockSize; };
+			for (size_t blockMinY = minY; blockMinY <= maxY; blockMinY = nextBlockStart(blockMinY))
+			{
+				const size_t blockMaxY = std::min(maxY, nextBlockStart(blockMinY) - 1);
+				for (size_t blockMinX = minX; blockMinX <= maxX; blockMinX = nextBlockStart(blockMinX))
+				{
+					const size_t blockMaxX = std::min(maxX, nextBlockStart(blockMinX) - 1);
+
+					const int64_t cornerX = static_cast<int64_t>(blockMinX) * subTexelSteps + subTexelSteps / 2;
+					const int64_t cornerY = static_cast<int64_t>(blockMinY) * subTexelSteps + subTexelSteps / 2;
+					const int64_t spanX = static_cast<int64_t>(blockMaxX - blockMinX) * subTexelSteps;
+					const int64_t spanY = static_cast<int64_t>(blockMaxY - blockMinY) * subTexelSteps;
+
+					bool isOutside = false;
+					bool isFullyCovered = true;
+					for (const EdgeFunction &edge : edges)
+					{
+						//edge functions are linear, so their extremes over the block are at its corners
+						const int64_t cornerValue = edge.evaluate(cornerX, cornerY) + edge.bias;
+						const int64_t padding = (std::abs(edge.a) + std::abs(edge.b)) * samplePadding;
+						const int64_t maxValue = cornerValue + std::max<int64_t>(edge.a * spanX, 0) + std::max<int64_t>(edge.b * spanY, 0) + padding;
+						const int64_t minValue = cornerValue + std::min<int64_t>(edge.a * spanX, 0) + std::min<int64_t>(edge.b * spanY, 0) - padding;
+						isOutside |= maxValue < 0;
+						isFullyCovered &= minValue >= 0;
+					}
+
+					if (isOutside) continue;
+
+					if constexpr (isQuadShaded)
+					{
+						shadeQuads(blockMinX, blockMinY, blockMaxX, blockMaxY, isFullyCovered);
+					}
+					else
+					{
+						shadeBlock(blockMinX, blockMinY, blockMaxX, blockMaxY, isFullyCovered);
+					}
+				}
+			}
+
+			return passedSamples;
 		}
 	};
 
@@ -0,0 +1,288 @@
+#include "JobSystem.h"
+#include "Profiler.h"
+#include <thread>
+#include <string>
+#include <deque>
+#include <memory>
+#include <condition_variable>
+
+namespace
+{
+	//already wrapped to release its counter once done
+	using QueuedJob = JobSystem::Job;
+
+	struct WorkQueue
+	{
+		std::mutex mutex;
+		std::deque<QueuedJob> jobs;
+	};
+
+	struct Scheduler
+	{
+		~Scheduler()
+		{
+			//the workers use the queues, they have to be stopped first
+			stop();
+		}
+
+		void stop()
+		{
+			{
+				std::lock_guard lock(sleepMutex);
+				isStopping.store(true, std::memory_order_release);
+			}
+			wakeUp.notify_all();
+
+			for (std::thread &worker : workers)
+			{
+				worker.join();
+			}
+			workers.clear();
+			queues.clear();
+			queuedJobCount.store(0, std::memory_order_release);
+			isInitialized.store(false, std::memory_order_release);
+		}
+
+		//index 0 is shared by every thread that isn't a worker, the workers own the others
+		std::vector<std::unique_ptr<WorkQueue>> queues;
+		std::vector<std::thread> workers;
+		std::mutex initializationMutex;
+		std::atomic<bool> isInitialized = false;
+		std::atomic<bool> isStopping = false;
+
+		std::atomic<size_t> queuedJobCount = 0;
+		std::mutex sleepMutex;
+		std::condition_variable wakeUp;
+	};
+
+	//framebuffers clear themselves when constructed, which can happen during static initialization
+	//so the scheduler is created on first use rather than being a global of this file
+	Scheduler &scheduler()
+	{
+		static Scheduler instance;
+		return instance;
+	}
+
+	thread_local size_t ownQueue = 0;
+	thread_local uint32_t stealSeed = 0;
+
+	bool tryPopOwn(Scheduler &state, QueuedJob &out)
+	{
+		WorkQueue &queue = *state.queues[ownQueue];
+		std::lock_guard lock(queue.mutex);
+		if (queue.jobs.empty()) return false;
+
+		//the most recently pushed job is the most likely to still be in cache
+		out = std::move(queue.jobs.back());
+		queue.jobs.pop_back();
+		return true;
+	}
+
+	bool trySteal(Scheduler &state, QueuedJob &out)
+	{
+		const size_t queueCount = state.queues.size();
+		stealSeed = stealSeed * 1664525U + 1013904223U;
+		const size_t start = stealSeed % queueCount;
+		for (size_t i = 0; i < queueCount; i++)
+		{
+			const size_t victim = (start + i) % queueCount;
+			if (victim == ownQueue) continue;
+
+			WorkQueue &queue = *state.queues[victim];
+			std::lock_guard lock(queue.mutex);
+			if (queue.jobs.empty()) continue;
+
+			//the oldest job, which tends to be the biggest piece of work left
+			out = std::move(queue.jobs.front());
+			queue.jobs.pop_front();
+			return true;
+		}
+		return false;
+	}
+
+	bool tryGetJob(Scheduler &state, QueuedJob &out)
+	{
+		if (state.queuedJobCount.load(std::memory_order_acquire) == 0) return false;
+		if (tryPopOwn(state, out) || trySteal(state, out))
+		{
+			state.queuedJobCount.fetch_sub(1, std::memory_order_acq_rel);
+			return true;
+		}
+		return false;
+	}
+
+	void push(Scheduler &state, QueuedJob &&job)
+	{
+		//counted first so that the count is never below the number of queued jobs
+		state.queuedJobCount.fetch_add(1, std::memory_order_acq_rel);
+		{
+			WorkQueue &queue = *state.queues[ownQueue];
+			std::lock_guard lock(queue.mutex);
+			queue.jobs.push_back(std::move(job));
+		}
+
+		//taking the lock makes sure a worker about to sleep sees the job
+		{
+			std::lock_guard lock(state.sleepMutex);
+		}
+		state.wakeUp.notify_one();
+	}
+
+	void workerLoop(Scheduler &state, size_t queueIndex)
+	{
+		ownQueue = queueIndex;
+		stealSeed = static_cast<uint32_t>(queueIndex) * 2654435761U;
+		Profiler::nameThread("worker " + std::to_string(queueIndex));
+
+		while (!state.isStopping.load(std::memory_order_acquire))
+		{
+			QueuedJob job;
+			if (tryGetJob(state, job))
+			{
+				TRACE_ZONE("job");
+				job();
+				continue;
+			}
+
+			std::unique_lock lock(state.sleepMutex);
+			state.wakeUp.wait(lock, [&state]()
+			{
+				return state.isStopping.load(std::memory_order_acquire) || state.queuedJobCount.load(std::memory_order_acquire) > 0;
+			});
+		}
+	}
+
+	Scheduler &initializedScheduler()
+	{
+		Scheduler &state = scheduler();
+		if (!state.isInitialized.load(std::memory_order_acquire))
+		{
+			JobSystem::initialize();
+		}
+		return state;
+	}
+}
+
+void JobSystem::initialize(size_t workerCount)
+{
+	Scheduler &state = scheduler();
+	std::lock_guard lock(state.initializationMutex);
+	if (state.isInitialized.load(std::memory_order_acquire)) return;
+
+	if (workerCount == 0)
+	{
+		//the thread calling in helps while it waits, so it counts as one of them
+		const size_t hardwareThreads = std::thread::hardware_concurrency();
+		workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+	}
+
+	state.isStopping.store(false, std::memory_order_release);
+	for (size_t i = 0; i < workerCount + 1; i++)
+	{
+		state.queues.push_back(std::make_unique<WorkQueue>());
+	}
+	for (size_t i = 0; i < workerCount; i++)
+	{
+		state.workers.emplace_back(workerLoop, std::ref(state), i + 1);
+	}
+	state.isInitialized.store(true, std::memory_order_release);
+}
+
+void JobSystem::shutdown()
+{
+	Scheduler &state = scheduler();
+	std::lock_guard lock(state.initializationMutex);
+	if (state.isInitialized.load(std::memory_order_acquire))
+	{
+		state.stop();
+	}
+}
+
+size_t JobSystem::workerCount()
+{
+	return initializedScheduler().workers.size();
+}
+
+bool JobSystem::isWorkerThread()
+{
+	return ownQueue != 0;
+}
+
+void JobSystem::run(Job job, JobCounter *counter)
+{
+	Scheduler &state = initializedScheduler();
+	if (counter != nullptr)
+	{
+		counter->pending.fetch_add(1, std::memory_order_acq_rel);
+	}
+	push(state, wrap(std::move(job), counter));
+}
+
+void JobSystem::runAfter(JobCounter &dependency, Job job, JobCounter *counter)
+{
+	Scheduler &state = initializedScheduler();
+	if (counter != nullptr)
+	{
+		counter->pending.fetch_add(1, std::memory_order_acq_rel);
+	}
+
+	{
+		std::lock_guard lock(dependency.continuationsMutex);
+		if (dependency.pending.load(std::memory_order_acquire) != 0)
+		{
+			dependency.continuations.push_back(wrap(std::move(job), counter));
+			return;
+		}
+	}
+
+	push(state, wrap(std::move(job), counter));
+}
+
+void JobSystem::wait(JobCounter &counter)
+{
+	Scheduler &state = initializedScheduler();
+	while (!counter.isDone())
+	{
+		QueuedJob job;
+		if (tryGetJob(state, job))
+		{
+			TRACE_ZONE("job");
+			job();
+		}
+		else
+		{
+			//the jobs we wait on are running elsewhere
+			std::this_thread::yield();
+		}
+	}
+
+	//the last job may still be releasing the counter, which can be destroyed as soon as we return
+	std::lock_guard lock(counter.continuationsMutex);
+}
+
+JobSystem::Job JobSystem::wrap(Job job, JobCounter *counter)
+{
+	if (counter == nullptr) return job;
+
+	return [job = std::move(job), counter]()
+	{
+		job();
+		release(*counter);
+	};
+}
+
+void JobSystem::release(JobCounter &counter)
+{
+	std::vector<Job> continuations;
+	{
+		std::lock_guard lock(counter.continuationsMutex);
+		if (counter.pending.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+		continuations.swap(counter.continuations);
+	}
+
+	Scheduler &state = scheduler();
+	for (Job &continuation : continuations)
+	{
+		push(state, std::move(continuation));
+	}
+}
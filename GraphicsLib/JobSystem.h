@@ -0,0 +1,89 @@
+#pragma once
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <vector>
+#include <cstdint>
+
+//counts the jobs still running, jobs can be scheduled to start once it reaches zero
+class JobCounter
+{
+public:
+	JobCounter() = default;
+	JobCounter(const JobCounter &) = delete;
+	JobCounter &operator=(const JobCounter &) = delete;
+
+	[[nodiscard]]
+	bool isDone() const
+	{
+		return pending.load(std::memory_order_acquire) == 0;
+	}
+
+private:
+	friend class JobSystem;
+
+	std::atomic<uint32_t> pending = 0;
+	std::mutex continuationsMutex;
+	std::vector<std::function<void()>> continuations;
+};
+
+//work stealing scheduler shared by every stage of the library
+//each worker owns a deque it pushes to and pops from the back of, idle workers steal from the front of the others'
+class JobSystem
+{
+public:
+	using Job = std::function<void()>;
+
+	//starts the workers, this is otherwise done on first use with one worker per hardware thread
+	static void initialize(size_t workerCount = 0);
+
+	//waits for the workers to finish their current job and stops them, pending jobs are dropped
+	static void shutdown();
+
+	[[nodiscard]]
+	static size_t workerCount();
+
+	//whether the calling thread is one of the workers, rather than a thread helping while it waits
+	[[nodiscard]]
+	static bool isWorkerThread();
+
+	//runs the job on any thread, the counter is decremented once it is done
+	static void run(Job job, JobCounter *counter = nullptr);
+
+	//runs the job once the dependency reaches zero
+	static void runAfter(JobCounter &dependency, Job job, JobCounter *counter = nullptr);
+
+	//executes pending jobs on the calling thread until the counter reaches zero
+	static void wait(JobCounter &counter);
+
+	//calls function(begin, end) over [0, count) in ranges of grainSize elements and waits for all of them
+	//ranges always start at multiples of grainSize, whatever the thread they end up on
+	template<typename Function_t>
+	static void parallelFor(size_t count, size_t grainSize, const Function_t &function)
+	{
+		if (grainSize == 0) grainSize = 1;
+		if (count <= grainSize)
+		{
+			if (count > 0) function(size_t(0), count);
+			return;
+		}
+
+		JobCounter counter;
+		for (size_t begin = grainSize; begin < count; begin += grainSize)
+		{
+			const size_t end = begin + grainSize < count ? begin + grainSize : count;
+			run([&function, begin, end]() { function(begin, end); }, &counter);
+		}
+
+		//the first range is ours, the others are likely to be stolen meanwhile
+		function(size_t(0), grainSize);
+		wait(counter);
+	}
+
+private:
+	JobSystem() = delete;
+
+	//makes the job decrement the counter once it returns, starting whatever waited on it
+	static Job wrap(Job job, JobCounter *counter);
+	static void release(JobCounter &counter);
+};
@@ -0,0 +1,83 @@
+#include "MappedFile.h"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN 1
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace gl
+{
+#ifdef _WIN32
+	MappedFile::MappedFile(const char *path, size_t size) : byteCount(size)
+	{
+		file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			file = nullptr;
+			throw std::runtime_error("File open failed!");
+		}
+		//empty files can't be mapped, there's nothing to write to anyway
+		if (size == 0) return;
+
+		//the mapping grows the file to its size
+		mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, static_cast<DWORD>(uint64_t(size) >> 32), static_cast<DWORD>(size), nullptr);
+		if (mapping != nullptr)
+		{
+			contents = static_cast<uint8_t *>(MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, size));
+		}
+		if (contents == nullptr)
+		{
+			close();
+			throw std::runtime_error("File mapping failed!");
+		}
+	}
+
+	void MappedFile::close()
+	{
+		if (contents != nullptr) UnmapViewOfFile(contents);
+		if (mapping != nullptr) CloseHandle(mapping);
+		if (file != nullptr) CloseHandle(file);
+		contents = nullptr;
+		mapping = nullptr;
+		file = nullptr;
+	}
+#else
+	MappedFile::MappedFile(const char *path, size_t size) : byteCount(size)
+	{
+		file = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if (file < 0) throw std::runtime_error("File open failed!");
+		//empty files can't be mapped, there's nothing to write to anyway
+		if (size == 0) return;
+
+		if (ftruncate(file, static_cast<off_t>(size)) == 0)
+		{
+			void *mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+			if (mapped != MAP_FAILED) contents = static_cast<uint8_t *>(mapped);
+		}
+		if (contents == nullptr)
+		{
+			close();
+			throw std::runtime_error("File mapping failed!");
+		}
+	}
+
+	void MappedFile::close()
+	{
+		if (contents != nullptr) munmap(contents, byteCount);
+		if (file >= 0) ::close(file);
+		contents = nullptr;
+		file = -1;
+	}
+#endif
+
+	MappedFile::~MappedFile()
+	{
+		close();
+	}
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+namespace gl
+{
+	//a file created at its final size and mapped to memory, so that it is written to like an array
+	//the system writes the pages back on its own, without copying them through a stream's buffers first
+	class MappedFile
+	{
+	public:
+
+		//replaces any file at the path, throws when it can't be created or mapped
+		MappedFile(const char *path, size_t size);
+		//unmaps and closes the file
+		~MappedFile();
+
+		MappedFile(const MappedFile &) = delete;
+		MappedFile &operator=(const MappedFile &) = delete;
+
+		[[nodiscard]]
+		uint8_t *data()
+		{
+			return contents;
+		}
+
+		[[nodiscard]]
+		size_t size() const
+		{
+			return byteCount;
+		}
+
+	private:
+
+		void close();
+
+#ifdef _WIN32
+		//handles, kept as void pointers for Windows.h not to be included everywhere
+		void *file = nullptr;
+		void *mapping = nullptr;
+#else
+		int file = -1;
+#endif
+		uint8_t *contents = nullptr;
+		size_t byteCount;
+	};
+}
@@ -0,0 +1,349 @@
+#include "MeshOptimizer.h"
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+namespace
+{
+	struct VertexBits
+	{
+		const Triangle::Vertex *vertex;
+
+		bool operator==(const VertexBits &other) const
+		{
+			return memcmp(vertex, other.vertex, sizeof(Triangle::Vertex)) == 0;
+		}
+	};
+
+	struct VertexBitsHash
+	{
+		size_t operator()(const VertexBits &key) const
+		{
+			//FNV-1a over the raw bytes, the vertex is only made of floats so there's no padding to worry about
+			const unsigned char *bytes = reinterpret_cast<const unsigned char *>(key.vertex);
+			uint64_t hash = 14695981039346656037ULL;
+			for (size_t i = 0; i < sizeof(Triangle::Vertex); i++)
+			{
+				hash ^= bytes[i];
+				hash *= 1099511628211ULL;
+			}
+			return static_cast<size_t>(hash);
+		}
+	};
+
+	//scoring constants from the original paper
+	constexpr float cacheDecayPower = 1.5f;
+	constexpr float lastTriangleScore = .75f;
+	constexpr float valenceBoostScale = 2.0f;
+	constexpr float valenceBoostPower = .5f;
+
+	float calculateVertexScore(int cachePosition, uint32_t remainingValence, size_t cacheSize)
+	{
+		if (remainingValence == 0)
+		{
+			//no triangle left to draw with this vertex
+			return -1.0f;
+		}
+
+		float score = .0f;
+		if (cachePosition >= 0)
+		{
+			if (cachePosition < 3)
+			{
+				//used by the last triangle, fixed score so that we don't favour any of its edges
+				score = lastTriangleScore;
+			}
+			else
+			{
+				const float scaler = 1.0f / static_cast<float>(cacheSize - 3);
+				score = powf(1.0f - static_cast<float>(cachePosition - 3) * scaler, cacheDecayPower);
+			}
+		}
+
+		score += valenceBoostScale * powf(static_cast<float>(remainingValence), -valenceBoostPower);
+		return score;
+	}
+
+	vec3 positionOf(const IndexedMesh &mesh, uint32_t index)
+	{
+		return mesh.vertices[index].position.xyz();
+	}
+}
+
+IndexedMesh MeshOptimizer::buildIndexedMesh(const std::vector<Triangle> &triangles)
+{
+	IndexedMesh mesh = {};
+	mesh.indices.reserve(triangles.size() * 3);
+
+	std::unordered_map<VertexBits, uint32_t, VertexBitsHash> vertexToIndex;
+	vertexToIndex.reserve(triangles.size() * 3);
+
+	for (const Triangle &triangle : triangles)
+	{
+		for (const Triangle::Vertex &vertex : triangle.vertices)
+		{
+			const auto [iterator, inserted] = vertexToIndex.try_emplace(VertexBits{ &vertex }, static_cast<uint32_t>(mesh.vertices.size()));
+			if (inserted)
+			{
+				mesh.vertices.push_back(vertex);
+			}
+			mesh.indices.push_back(iterator->second);
+		}
+	}
+
+	return mesh;
+}
+
+void MeshOptimizer::optimize(IndexedMesh &mesh)
+{
+	optimizeVertexCache(mesh);
+	optimizeOverdraw(mesh);
+	optimizeVertexFetch(mesh);
+}
+
+void MeshOptimizer::optimizeVertexCache(IndexedMesh &mesh, size_t cacheSize)
+{
+	const size_t vertexCount = mesh.vertices.size();
+	const size_t triangleCount = mesh.triangleCount();
+	if (triangleCount == 0 || cacheSize <= 3) return;
+
+	const float originalACMR = calculateACMR(mesh, cacheSize);
+
+	//vertex -> triangles adjacency, stored contiguously
+	std::vector<uint32_t> remainingValence(vertexCount, 0U);
+	for (const uint32_t index : mesh.indices)
+	{
+		remainingValence[index]++;
+	}
+
+	std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0U);
+	for (size_t i = 0; i < vertexCount; i++)
+	{
+		adjacencyOffsets[i + 1] = adjacencyOffsets[i] + remainingValence[i];
+	}
+
+	std::vector<uint32_t> adjacency(mesh.indices.size());
+	{
+		std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (size_t i = 0; i < mesh.indices.size(); i++)
+		{
+			adjacency[fill[mesh.indices[i]]++] = static_cast<uint32_t>(i / 3);
+		}
+	}
+
+	std::vector<float> vertexScores(vertexCount);
+	for (size_t i = 0; i < vertexCount; i++)
+	{
+		vertexScores[i] = calculateVertexScore(-1, remainingValence[i], cacheSize);
+	}
+
+	auto calculateTriangleScore = [&](size_t triangle)
+	{
+		return vertexScores[mesh.indices[triangle * 3]] + vertexScores[mesh.indices[triangle * 3 + 1]] + vertexScores[mesh.indices[triangle * 3 + 2]];
+	};
+
+	std::vector<bool> emitted(triangleCount, false);
+
+	std::vector<uint32_t> cache, nextCache;
+	cache.reserve(cacheSize + 3);
+	nextCache.reserve(cacheSize + 3);
+
+	std::vector<uint32_t> newIndices;
+	newIndices.reserve(mesh.indices.size());
+
+	constexpr size_t noTriangle = std::numeric_limits<size_t>::max();
+	size_t bestTriangle = 0;
+	for (size_t i = 1; i < triangleCount; i++)
+	{
+		if (calculateTriangleScore(i) > calculateTriangleScore(bestTriangle)) bestTriangle = i;
+	}
+	size_t fallbackCursor = 0;
+
+	for (size_t emittedCount = 0; emittedCount < triangleCount; emittedCount++)
+	{
+		if (bestTriangle == noTriangle)
+		{
+			//nothing in the cache has triangles left, pick the next one in the original order
+			while (emitted[fallbackCursor]) fallbackCursor++;
+			bestTriangle = fallbackCursor;
+		}
+
+		emitted[bestTriangle] = true;
+		const uint32_t *triangleIndices = &mesh.indices[bestTriangle * 3];
+
+		nextCache.clear();
+		for (size_t i = 0; i < 3; i++)
+		{
+			const uint32_t vertex = triangleIndices[i];
+			newIndices.push_back(vertex);
+			nextCache.push_back(vertex);
+
+			//remove the triangle from this vertex's remaining ones
+			uint32_t *begin = &adjacency[adjacencyOffsets[vertex]];
+			uint32_t *end = begin + remainingValence[vertex];
+			uint32_t *found = std::find(begin, end, static_cast<uint32_t>(bestTriangle));
+			std::swap(*found, *(end - 1));
+			remainingValence[vertex]--;
+		}
+
+		for (const uint32_t vertex : cache)
+		{
+			if (vertex != triangleIndices[0] && vertex != triangleIndices[1] && vertex != triangleIndices[2])
+			{
+				nextCache.push_back(vertex);
+			}
+		}
+
+		//vertices pushed out of the cache
+		for (size_t i = cacheSize; i < nextCache.size(); i++)
+		{
+			vertexScores[nextCache[i]] = calculateVertexScore(-1, remainingValence[nextCache[i]], cacheSize);
+		}
+		if (nextCache.size() > cacheSize) nextCache.resize(cacheSize);
+
+		for (size_t i = 0; i < nextCache.size(); i++)
+		{
+			vertexScores[nextCache[i]] = calculateVertexScore(static_cast<int>(i), remainingValence[nextCache[i]], cacheSize);
+		}
+
+		//only triangles touching the cache can have changed, so the best one is among them
+		bestTriangle = noTriangle;
+		float bestScore = -std::numeric_limits<float>::max();
+		for (const uint32_t vertex : nextCache)
+		{
+			for (uint32_t j = 0; j < remainingValence[vertex]; j++)
+			{
+				const uint32_t triangle = adjacency[adjacencyOffsets[vertex] + j];
+				const float score = calculateTriangleScore(triangle);
+				if (score > bestScore)
+				{
+					bestScore = score;
+					bestTriangle = triangle;
+				}
+			}
+		}
+
+		std::swap(cache, nextCache);
+	}
+
+	//the scores are a heuristic, an order that was already good for the cache can come out worse and is then kept
+	std::vector<uint32_t> originalIndices = std::exchange(mesh.indices, std::move(newIndices));
+	if (calculateACMR(mesh, cacheSize) > originalACMR)
+	{
+		mesh.indices = std::move(originalIndices);
+	}
+}
+
+void MeshOptimizer::optimizeOverdraw(IndexedMesh &mesh, size_t clusterSize)
+{
+	const size_t triangleCount = mesh.triangleCount();
+	if (clusterSize == 0 || triangleCount <= clusterSize) return;
+
+	struct Cluster
+	{
+		size_t firstTriangle;
+		size_t triangleCount;
+		float sortKey;
+	};
+
+	vec3 meshCentroid = {};
+	float meshArea = .0f;
+
+	std::vector<Cluster> clusters;
+	std::vector<vec3> clusterCentroids, clusterNormals;
+	for (size_t first = 0; first < triangleCount; first += clusterSize)
+	{
+		const size_t count = std::min(clusterSize, triangleCount - first);
+
+		vec3 centroid = {}, normal = {};
+		float area = .0f;
+		for (size_t triangle = first; triangle < first + count; triangle++)
+		{
+			const vec3 a = positionOf(mesh, mesh.indices[triangle * 3]);
+			const vec3 b = positionOf(mesh, mesh.indices[triangle * 3 + 1]);
+			const vec3 c = positionOf(mesh, mesh.indices[triangle * 3 + 2]);
+
+			//the cross product's length is twice the area, which we use as the weight
+			const vec3 areaNormal = vec3::cross(b - a, c - a);
+			const float triangleArea = areaNormal.length();
+
+			centroid += (a + b + c) * (triangleArea / 3.0f);
+			normal += areaNormal;
+			area += triangleArea;
+		}
+
+		meshCentroid += centroid;
+		meshArea += area;
+
+		clusters.push_back({ .firstTriangle = first, .triangleCount = count, .sortKey = .0f });
+		clusterCentroids.push_back(area > .0f ? centroid / area : centroid);
+		clusterNormals.push_back(normal);
+	}
+
+	if (meshArea > .0f) meshCentroid /= meshArea;
+
+	for (size_t i = 0; i < clusters.size(); i++)
+	{
+		const float normalLength = clusterNormals[i].length();
+		const vec3 normal = normalLength > .0f ? clusterNormals[i] / normalLength : vec3();
+		clusters[i].sortKey = vec3::dot(clusterCentroids[i] - meshCentroid, normal);
+	}
+
+	//clusters facing away from the center are the most likely to occlude others
+	std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster &a, const Cluster &b) { return a.sortKey > b.sortKey; });
+
+	std::vector<uint32_t> newIndices;
+	newIndices.reserve(mesh.indices.size());
+	for (const Cluster &cluster : clusters)
+	{
+		const auto begin = mesh.indices.begin() + cluster.firstTriangle * 3;
+		newIndices.insert(newIndices.end(), begin, begin + cluster.triangleCount * 3);
+	}
+
+	mesh.indices = std::move(newIndices);
+}
+
+void MeshOptimizer::optimizeVertexFetch(IndexedMesh &mesh)
+{
+	constexpr uint32_t unassigned = std::numeric_limits<uint32_t>::max();
+	std::vector<uint32_t> remap(mesh.vertices.size(), unassigned);
+
+	std::vector<Triangle::Vertex> newVertices;
+	newVertices.reserve(mesh.vertices.size());
+
+	for (uint32_t &index : mesh.indices)
+	{
+		if (remap[index] == unassigned)
+		{
+			remap[index] = static_cast<uint32_t>(newVertices.size());
+			newVertices.push_back(mesh.vertices[index]);
+		}
+		index = remap[index];
+	}
+
+	mesh.vertices = std::move(newVertices);
+}
+
+float MeshOptimizer::calculateACMR(const IndexedMesh &mesh, size_t cacheSize)
+{
+	if (mesh.triangleCount() == 0) return .0f;
+
+	std::vector<uint32_t> cache;
+	cache.reserve(cacheSize + 1);
+
+	size_t misses = 0;
+	for (const uint32_t index : mesh.indices)
+	{
+		if (std::find(cache.begin(), cache.end(), index) == cache.end())
+		{
+			misses++;
+			cache.insert(cache.begin(), index);
+			if (cache.size() > cacheSize) cache.pop_back();
+		}
+	}
+
+	return static_cast<float>(misses) / static_cast<float>(mesh.triangleCount());
+}
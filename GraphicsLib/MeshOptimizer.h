@@ -0,0 +1,50 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include "Triangle.h"
+
+struct IndexedMesh
+{
+	std::vector<Triangle::Vertex> vertices;
+	std::vector<uint32_t> indices;
+
+	[[nodiscard]]
+	size_t triangleCount() const noexcept
+	{
+		return indices.size() / 3;
+	}
+};
+
+class MeshOptimizer
+{
+public:
+
+	//welds bitwise identical vertices together, keeping the original triangle order
+	[[nodiscard]]
+	static IndexedMesh buildIndexedMesh(const std::vector<Triangle> &triangles);
+
+	//runs the vertex cache, overdraw and vertex fetch passes, in that order
+	static void optimize(IndexedMesh &mesh);
+
+	//reorders triangles for post-transform vertex cache reuse, never ending up with a higher ACMR than the original order
+	//based on : https://tomforsyth1000.github.io/papers/fast_vert_cache_opt.html
+	static void optimizeVertexCache(IndexedMesh &mesh, size_t cacheSize = defaultCacheSize);
+
+	//reorders clusters of triangles so that outward facing ones are drawn first
+	//viewpoint independent, as described in "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw" (Sander et al.)
+	//expects the indices to already be optimized for the vertex cache, clusters are runs of clusterSize triangles
+	static void optimizeOverdraw(IndexedMesh &mesh, size_t clusterSize = defaultClusterSize);
+
+	//reorders vertices by first use in the index buffer, dropping unreferenced ones
+	static void optimizeVertexFetch(IndexedMesh &mesh);
+
+	//average cache miss ratio of a FIFO cache of the given size, 3.0 being the worst and ~0.5 the best for regular meshes
+	[[nodiscard]]
+	static float calculateACMR(const IndexedMesh &mesh, size_t cacheSize = defaultCacheSize);
+
+	static constexpr size_t defaultCacheSize = 32;
+	static constexpr size_t defaultClusterSize = 64;
+
+private:
+	MeshOptimizer() = delete;
+};
@@ -0,0 +1,248 @@
+#include "Meshlets.h"
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+namespace
+{
+	culling::Sphere calculateBounds(const IndexedMesh &mesh, const uint32_t *vertexIndices, size_t vertexCount)
+	{
+		vec3 min = mesh.vertices[vertexIndices[0]].position.xyz(), max = min;
+		for (size_t i = 1; i < vertexCount; i++)
+		{
+			const vec3 position = mesh.vertices[vertexIndices[i]].position.xyz();
+			for (size_t axis = 0; axis < vec3::size(); axis++)
+			{
+				min[axis] = std::min(min[axis], position[axis]);
+				max[axis] = std::max(max[axis], position[axis]);
+			}
+		}
+
+		culling::Sphere sphere = { .center = (min + max) * .5f, .radius = .0f };
+		for (size_t i = 0; i < vertexCount; i++)
+		{
+			const vec3 position = mesh.vertices[vertexIndices[i]].position.xyz();
+			sphere.radius = std::max(sphere.radius, (position - sphere.center).length());
+		}
+		return sphere;
+	}
+
+	culling::Cone calculateCone(const IndexedMesh &mesh, const uint32_t *vertexIndices, const uint8_t *localIndices, size_t triangleCount)
+	{
+		std::vector<vec3> normals;
+		normals.reserve(triangleCount);
+
+		vec3 axis = {};
+		for (size_t i = 0; i < triangleCount; i++)
+		{
+			const vec3 a = mesh.vertices[vertexIndices[localIndices[i * 3]]].position.xyz();
+			const vec3 b = mesh.vertices[vertexIndices[localIndices[i * 3 + 1]]].position.xyz();
+			const vec3 c = mesh.vertices[vertexIndices[localIndices[i * 3 + 2]]].position.xyz();
+
+			const vec3 normal = vec3::cross(b - a, c - a);
+			const float length = normal.length();
+			if (length <= std::numeric_limits<float>::epsilon())
+			{
+				//degenerate triangles never get drawn, they don't constrain the cone
+				continue;
+			}
+
+			normals.push_back(normal / length);
+			axis += normals.back();
+		}
+
+		const float axisLength = axis.length();
+		if (normals.empty() || axisLength <= std::numeric_limits<float>::epsilon())
+		{
+			return {};
+		}
+		axis /= axisLength;
+
+		float minDot = 1.0f;
+		for (const vec3 &normal : normals)
+		{
+			minDot = std::min(minDot, vec3::dot(normal, axis));
+		}
+
+		if (minDot <= .0f)
+		{
+			//the normals span over a hemisphere, some triangle is always front facing
+			return {};
+		}
+
+		return { .axis = axis, .cutoff = sqrtf(1.0f - minDot * minDot) };
+	}
+}
+
+MeshletMesh MeshletBuilder::build(const IndexedMesh &mesh)
+{
+	MeshletMesh result = {};
+
+	constexpr uint8_t notInMeshlet = std::numeric_limits<uint8_t>::max();
+	std::vector<uint8_t> localVertexIndices(mesh.vertices.size(), notInMeshlet);
+
+	Meshlet current = {};
+	//the mesh's index of each triangle of the current meshlet
+	std::vector<uint32_t> currentTriangles;
+	//the lowest of them, for each finished meshlet
+	std::vector<uint32_t> firstTriangles;
+
+	auto finishMeshlet = [&]()
+	{
+		if (current.triangleCount == 0) return;
+
+		//triangles are drawn in the mesh's order, which the optimizer chose for the vertex cache and overdraw
+		std::vector<uint32_t> order(current.triangleCount);
+		std::iota(order.begin(), order.end(), 0U);
+		std::sort(order.begin(), order.end(), [&currentTriangles](uint32_t a, uint32_t b) { return currentTriangles[a] < currentTriangles[b]; });
+		uint8_t *localIndices = &result.localIndices[current.triangleOffset * 3];
+		const std::vector<uint8_t> grownIndices(localIndices, localIndices + current.triangleCount * 3);
+		for (uint32_t i = 0; i < current.triangleCount; i++)
+		{
+			std::copy_n(&grownIndices[order[i] * 3], 3, &localIndices[i * 3]);
+		}
+		firstTriangles.push_back(currentTriangles[order[0]]);
+		currentTriangles.clear();
+
+		const uint32_t *vertexIndices = &result.vertexIndices[current.vertexOffset];
+		current.bounds = calculateBounds(mesh, vertexIndices, current.vertexCount);
+		current.cone = calculateCone(mesh, vertexIndices, &result.localIndices[current.triangleOffset * 3], current.triangleCount);
+		result.meshlets.push_back(current);
+
+		for (uint32_t i = 0; i < current.vertexCount; i++)
+		{
+			localVertexIndices[vertexIndices[i]] = notInMeshlet;
+		}
+
+		current = {
+			.vertexOffset = static_cast<uint32_t>(result.vertexIndices.size()),
+			.triangleOffset = static_cast<uint32_t>(result.localIndices.size() / 3)
+		};
+	};
+
+	//vertex -> triangles adjacency, used to grow meshlets through shared vertices
+	std::vector<uint32_t> adjacencyOffsets(mesh.vertices.size() + 1, 0U);
+	for (const uint32_t index : mesh.indices)
+	{
+		adjacencyOffsets[index + 1]++;
+	}
+	for (size_t i = 0; i < mesh.vertices.size(); i++)
+	{
+		adjacencyOffsets[i + 1] += adjacencyOffsets[i];
+	}
+
+	std::vector<uint32_t> adjacency(mesh.indices.size());
+	{
+		std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (size_t i = 0; i < mesh.indices.size(); i++)
+		{
+			adjacency[fill[mesh.indices[i]]++] = static_cast<uint32_t>(i / 3);
+		}
+	}
+
+	const size_t triangleCount = mesh.triangleCount();
+	std::vector<bool> emitted(triangleCount, false);
+	size_t cursor = 0;
+
+	auto countNewVertices = [&](size_t triangle)
+	{
+		size_t newVertices = 0;
+		for (size_t j = 0; j < 3; j++)
+		{
+			if (localVertexIndices[mesh.indices[triangle * 3 + j]] == notInMeshlet) newVertices++;
+		}
+		return newVertices;
+	};
+
+	auto centroidOf = [&](size_t triangle)
+	{
+		return (mesh.vertices[mesh.indices[triangle * 3]].position.xyz() + 
+			mesh.vertices[mesh.indices[triangle * 3 + 1]].position.xyz() + 
+			mesh.vertices[mesh.indices[triangle * 3 + 2]].position.xyz()) / 3.0f;
+	};
+
+	//sum of the current meshlet's vertex positions, to keep meshlets compact
+	vec3 positionSum = {};
+	//vertices of the last finished meshlet, new meshlets start next to it
+	std::vector<uint32_t> previousVertices;
+
+	for (size_t emittedCount = 0; emittedCount < triangleCount; emittedCount++)
+	{
+		//prefer the triangle reusing the most vertices of the current meshlet, closest to its center on ties
+		const bool startingMeshlet = current.vertexCount == 0;
+		const vec3 center = startingMeshlet ? vec3() : positionSum / static_cast<float>(current.vertexCount);
+		size_t triangle = triangleCount;
+		size_t fewestNewVertices = 4;
+		float closestDistance = std::numeric_limits<float>::max();
+
+		auto consider = [&](uint32_t vertex)
+		{
+			for (uint32_t j = adjacencyOffsets[vertex]; j < adjacencyOffsets[vertex + 1]; j++)
+			{
+				const uint32_t candidate = adjacency[j];
+				if (emitted[candidate]) continue;
+
+				const size_t newVertices = countNewVertices(candidate);
+				const float distance = startingMeshlet ? .0f : (centroidOf(candidate) - center).squaredLength();
+				if (newVertices < fewestNewVertices || (newVertices == fewestNewVertices && distance < closestDistance))
+				{
+					fewestNewVertices = newVertices;
+					closestDistance = distance;
+					triangle = candidate;
+				}
+			}
+		};
+
+		if (startingMeshlet)
+		{
+			for (const uint32_t vertex : previousVertices) consider(vertex);
+		}
+		else
+		{
+			for (uint32_t i = 0; i < current.vertexCount; i++) consider(result.vertexIndices[current.vertexOffset + i]);
+		}
+
+		if (triangle == triangleCount)
+		{
+			//nothing connected to the meshlet, continue in index order
+			while (emitted[cursor]) cursor++;
+			triangle = cursor;
+		}
+
+		if (current.vertexCount + countNewVertices(triangle) > Meshlet::maxVertices || current.triangleCount + 1 > Meshlet::maxTriangles)
+		{
+			previousVertices.assign(result.vertexIndices.begin() + current.vertexOffset, result.vertexIndices.end());
+			positionSum = {};
+			finishMeshlet();
+		}
+
+		emitted[triangle] = true;
+		for (size_t j = 0; j < 3; j++)
+		{
+			const uint32_t vertex = mesh.indices[triangle * 3 + j];
+			if (localVertexIndices[vertex] == notInMeshlet)
+			{
+				localVertexIndices[vertex] = static_cast<uint8_t>(current.vertexCount++);
+				result.vertexIndices.push_back(vertex);
+				positionSum += mesh.vertices[vertex].position.xyz();
+			}
+			result.localIndices.push_back(localVertexIndices[vertex]);
+		}
+		currentTriangles.push_back(static_cast<uint32_t>(triangle));
+		current.triangleCount++;
+	}
+	finishMeshlet();
+
+	//meshlets are grown for culling, but drawn in the order the mesh would have been
+	std::vector<size_t> meshletOrder(result.meshlets.size());
+	std::iota(meshletOrder.begin(), meshletOrder.end(), size_t(0));
+	std::stable_sort(meshletOrder.begin(), meshletOrder.end(), [&firstTriangles](size_t a, size_t b) { return firstTriangles[a] < firstTriangles[b]; });
+	std::vector<Meshlet> sortedMeshlets(result.meshlets.size());
+	for (size_t i = 0; i < meshletOrder.size(); i++)
+	{
+		sortedMeshlets[i] = result.meshlets[meshletOrder[i]];
+	}
+	result.meshlets = std::move(sortedMeshlets);
+
+	return result;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include "MeshOptimizer.h"
+#include "Culling.h"
+
+//a small cluster of triangles which can be culled as a whole
+struct Meshlet
+{
+	static constexpr size_t maxVertices = 64;
+	static constexpr size_t maxTriangles = 124;
+
+	uint32_t vertexOffset = 0, vertexCount = 0; //into MeshletMesh::vertexIndices
+	uint32_t triangleOffset = 0, triangleCount = 0; //into MeshletMesh::localIndices, three per triangle
+	culling::Sphere bounds = {};
+	culling::Cone cone = {};
+};
+
+struct MeshletMesh
+{
+	std::vector<Meshlet> meshlets;
+	//meshlet local vertex -> mesh vertex
+	std::vector<uint32_t> vertexIndices;
+	std::vector<uint8_t> localIndices;
+};
+
+class MeshletBuilder
+{
+public:
+
+	//grows meshlets through shared vertices, falling back to index order when a meshlet has no unused neighbours left
+	//triangles and meshlets are then put back in index order, keeping what the mesh optimizer did for overdraw
+	[[nodiscard]]
+	static MeshletMesh build(const IndexedMesh &mesh);
+
+private:
+	MeshletBuilder() = delete;
+};
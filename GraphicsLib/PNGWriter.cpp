@@ -0,0 +1,734 @@
+#include "PNGWriter.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+	//of filtered rows, each chunk is deflated on its own, so its matches don't reach into the previous one
+	constexpr size_t chunkSize = 256 * 1024;
+
+	constexpr size_t windowSize = 32768;
+	//a whole pixel, shorter matches hardly ever pay for themselves in filtered images
+	constexpr size_t minMatch = 4;
+	constexpr size_t maxMatch = 258;
+	constexpr uint32_t hashBits = 15;
+	//how many of the earlier positions with the same hash are compared, more compresses better and slower
+	constexpr size_t maxChainLength = 8;
+	constexpr size_t maxStoredBlockSize = 65535;
+
+	constexpr uint8_t maxCodeLength = 15;
+	constexpr uint8_t maxCodeLengthCodeLength = 7;
+	constexpr size_t literalLengthCount = 286;
+	constexpr size_t distanceCount = 30;
+	constexpr size_t codeLengthCount = 19;
+	constexpr uint16_t endOfBlock = 256;
+	constexpr uint16_t firstLengthCode = 257;
+
+	constexpr std::array<uint16_t, 29> lengthBases = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+	constexpr std::array<uint8_t, 29> lengthExtraBits = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+	constexpr std::array<uint16_t, 30> distanceBases = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+	constexpr std::array<uint8_t, 30> distanceExtraBits = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+	//the order the code length code's lengths are written in
+	constexpr std::array<uint8_t, codeLengthCount> codeLengthOrder = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+	//index in lengthBases of each match length
+	const std::array<uint8_t, maxMatch + 1> lengthCodes = []()
+	{
+		std::array<uint8_t, maxMatch + 1> codes = {};
+		for (size_t code = 0; code < lengthBases.size(); code++)
+		{
+			const size_t end = code + 1 < lengthBases.size() ? lengthBases[code + 1] : maxMatch + 1;
+			for (size_t length = lengthBases[code]; length < end; length++)
+			{
+				codes[length] = static_cast<uint8_t>(code);
+			}
+		}
+		return codes;
+	}();
+
+	uint8_t distanceCode(size_t distance)
+	{
+		return static_cast<uint8_t>(std::upper_bound(distanceBases.begin(), distanceBases.end(), distance) - distanceBases.begin() - 1);
+	}
+
+	const std::array<uint32_t, 256> crcTable = []()
+	{
+		std::array<uint32_t, 256> table = {};
+		for (uint32_t i = 0; i < 256; i++)
+		{
+			uint32_t crc = i;
+			for (size_t bit = 0; bit < 8; bit++)
+			{
+				crc = crc & 1 ? 0xedb88320u ^ (crc >> 1) : crc >> 1;
+			}
+			table[i] = crc;
+		}
+		return table;
+	}();
+
+	//continues from the crc of the data before, if any
+	uint32_t crc32(const uint8_t *data, size_t size, uint32_t crc = 0)
+	{
+		crc = ~crc;
+		for (size_t i = 0; i < size; i++)
+		{
+			crc = crcTable[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+		}
+		return ~crc;
+	}
+
+	constexpr uint32_t adlerModulo = 65521;
+
+	uint32_t adler32(const uint8_t *data, size_t size)
+	{
+		//the most bytes that can be summed before the sums could overflow
+		constexpr size_t maxBytesPerModulo = 5552;
+
+		uint32_t a = 1, b = 0;
+		while (size > 0)
+		{
+			const size_t count = std::min(size, maxBytesPerModulo);
+			for (size_t i = 0; i < count; i++)
+			{
+				a += data[i];
+				b += a;
+			}
+			a %= adlerModulo;
+			b %= adlerModulo;
+			data += count;
+			size -= count;
+		}
+		return b << 16 | a;
+	}
+
+	//the checksum of two consecutive pieces of data from theirs, as zlib's adler32_combine computes it
+	uint32_t adler32Combine(uint32_t first, uint32_t second, size_t secondSize)
+	{
+		const uint32_t remainder = static_cast<uint32_t>(secondSize % adlerModulo);
+		uint32_t a = first & 0xffff;
+		uint32_t b = (remainder * a) % adlerModulo;
+		a += (second & 0xffff) + adlerModulo - 1;
+		b += (first >> 16) + (second >> 16) + adlerModulo - remainder;
+		if (a >= adlerModulo) a -= adlerModulo;
+		if (a >= adlerModulo) a -= adlerModulo;
+		if (b >= adlerModulo * 2) b -= adlerModulo * 2;
+		if (b >= adlerModulo) b -= adlerModulo;
+		return b << 16 | a;
+	}
+
+	//deflate fills each byte starting from its least significant bit
+	class BitWriter
+	{
+	public:
+
+		explicit BitWriter(std::vector<uint8_t> &out) : out(out) {}
+
+		void write(uint32_t bits, uint32_t count)
+		{
+			buffer |= uint64_t(bits) << bitCount;
+			bitCount += count;
+			while (bitCount >= 8)
+			{
+				out.push_back(static_cast<uint8_t>(buffer));
+				buffer >>= 8;
+				bitCount -= 8;
+			}
+		}
+
+		void alignToByte()
+		{
+			if (bitCount > 0) write(0, 8 - bitCount);
+		}
+
+	private:
+
+		std::vector<uint8_t> &out;
+		uint64_t buffer = 0;
+		uint32_t bitCount = 0;
+	};
+
+	//lengths of a prefix code of at most maxLength bits fitted to the frequencies, 0 for the unused symbols
+	void buildCodeLengths(const uint32_t *frequencies, size_t count, uint8_t maxLength, uint8_t *lengths)
+	{
+		std::fill(lengths, lengths + count, uint8_t(0));
+
+		std::vector<uint16_t> symbols;
+		for (size_t symbol = 0; symbol < count; symbol++)
+		{
+			if (frequencies[symbol] > 0) symbols.push_back(static_cast<uint16_t>(symbol));
+		}
+		std::stable_sort(symbols.begin(), symbols.end(), [frequencies](uint16_t a, uint16_t b) { return frequencies[a] < frequencies[b]; });
+
+		if (symbols.empty()) return;
+		if (symbols.size() == 1)
+		{
+			lengths[symbols[0]] = 1;
+			return;
+		}
+
+		//Huffman's tree, built from two queues : the leaves sorted by frequency, and the nodes in the order they are made, which also is their weights'
+		const size_t leafCount = symbols.size();
+		std::vector<uint64_t> weights(2 * leafCount - 1, 0);
+		std::vector<size_t> parents(2 * leafCount - 1, 0);
+		for (size_t leaf = 0; leaf < leafCount; leaf++)
+		{
+			weights[leaf] = frequencies[symbols[leaf]];
+		}
+		size_t nextLeaf = 0, nextNode = leafCount;
+		for (size_t node = leafCount; node < weights.size(); node++)
+		{
+			for (size_t child = 0; child < 2; child++)
+			{
+				const bool isLeaf = nextLeaf < leafCount && (nextNode == node || weights[nextLeaf] <= weights[nextNode]);
+				const size_t smallest = isLeaf ? nextLeaf++ : nextNode++;
+				parents[smallest] = node;
+				weights[node] += weights[smallest];
+			}
+		}
+
+		//parents come after their children, the depths are found from the root down
+		std::vector<uint32_t> depths(weights.size(), 0);
+		std::array<uint32_t, maxCodeLength + 1> lengthCounts = {};
+		for (size_t node = weights.size() - 1; node-- > 0;)
+		{
+			depths[node] = depths[parents[node]] + 1;
+			if (node < leafCount) lengthCounts[std::min<uint32_t>(depths[node], maxLength)]++;
+		}
+
+		//shortening the deepest codes overfilled the code, longer codes are traded for shorter ones until it fits again
+		uint32_t total = 0;
+		for (uint32_t length = 1; length <= maxLength; length++)
+		{
+			total += lengthCounts[length] << (maxLength - length);
+		}
+		while (total > (1u << maxLength))
+		{
+			lengthCounts[maxLength]--;
+			for (uint32_t length = maxLength - 1u; length > 0; length--)
+			{
+				if (lengthCounts[length] > 0)
+				{
+					lengthCounts[length]--;
+					lengthCounts[length + 1] += 2;
+					break;
+				}
+			}
+			total--;
+		}
+
+		//the longest codes go to the least frequent symbols
+		size_t symbol = 0;
+		for (uint32_t length = maxLength; length > 0; length--)
+		{
+			for (uint32_t i = 0; i < lengthCounts[length]; i++)
+			{
+				lengths[symbols[symbol++]] = static_cast<uint8_t>(length);
+			}
+		}
+	}
+
+	//canonical codes for the lengths, bit reversed since deflate writes them from their most significant bit
+	void buildCodes(const uint8_t *lengths, size_t count, uint16_t *codes)
+	{
+		std::array<uint32_t, maxCodeLength + 1> lengthCounts = {};
+		for (size_t symbol = 0; symbol < count; symbol++)
+		{
+			lengthCounts[lengths[symbol]]++;
+		}
+		lengthCounts[0] = 0;
+
+		std::array<uint32_t, maxCodeLength + 1> nextCodes = {};
+		uint32_t code = 0;
+		for (size_t length = 1; length <= maxCodeLength; length++)
+		{
+			code = (code + lengthCounts[length - 1]) << 1;
+			nextCodes[length] = code;
+		}
+
+		for (size_t symbol = 0; symbol < count; symbol++)
+		{
+			const uint8_t length = lengths[symbol];
+			if (length == 0) continue;
+
+			const uint32_t canonical = nextCodes[length]++;
+			uint32_t reversed = 0;
+			for (uint8_t bit = 0; bit < length; bit++)
+			{
+				reversed |= ((canonical >> bit) & 1) << (length - 1 - bit);
+			}
+			codes[symbol] = static_cast<uint16_t>(reversed);
+		}
+	}
+
+	struct Token
+	{
+		//a literal byte when distance is 0, a match's length otherwise
+		uint16_t value;
+		uint16_t distance;
+	};
+
+	//greedy LZ77, positions with the same hash of their next 4 bytes are chained together
+	void findMatches(const uint8_t *data, size_t size, std::vector<Token> &tokens)
+	{
+		std::vector<int32_t> heads(size_t(1) << hashBits, -1);
+		std::vector<int32_t> previous(size, -1);
+		const auto hash = [data](size_t position)
+		{
+			uint32_t bytes;
+			std::memcpy(&bytes, data + position, sizeof(bytes));
+			return (bytes * 2654435761u) >> (32 - hashBits);
+		};
+		const auto insert = [&](size_t position)
+		{
+			if (position + minMatch > size) return;
+			const uint32_t positionHash = hash(position);
+			previous[position] = heads[positionHash];
+			heads[positionHash] = static_cast<int32_t>(position);
+		};
+
+		size_t position = 0;
+		while (position < size)
+		{
+			size_t bestLength = 0, bestDistance = 0;
+			if (position + minMatch <= size)
+			{
+				const size_t maxLength = std::min(maxMatch, size - position);
+				int32_t candidate = heads[hash(position)];
+				for (size_t chain = 0; chain < maxChainLength && candidate >= 0 && position - candidate <= windowSize; chain++)
+				{
+					const uint8_t *earlier = data + candidate;
+					const uint8_t *current = data + position;
+					size_t length = 0;
+					while (length < maxLength && earlier[length] == current[length]) length++;
+
+					if (length > bestLength)
+					{
+						bestLength = length;
+						bestDistance = position - candidate;
+						if (length == maxLength) break;
+					}
+					candidate = previous[candidate];
+				}
+			}
+
+			if (bestLength >= minMatch)
+			{
+				tokens.push_back({ static_cast<uint16_t>(bestLength), static_cast<uint16_t>(bestDistance) });
+				//the positions within the match are chained too, for the matches after it to find them
+				for (const size_t end = position + bestLength; position < end; position++)
+				{
+					insert(position);
+				}
+			}
+			else
+			{
+				tokens.push_back({ data[position], 0 });
+				insert(position);
+				position++;
+			}
+		}
+	}
+
+	void writeStoredBlocks(BitWriter &writer, std::vector<uint8_t> &out, const uint8_t *data, size_t size)
+	{
+		for (size_t offset = 0; offset < size; offset += maxStoredBlockSize)
+		{
+			const uint32_t blockSize = static_cast<uint32_t>(std::min(size - offset, maxStoredBlockSize));
+			//not the final block, stored
+			writer.write(0, 3);
+			writer.alignToByte();
+			writer.write(blockSize, 16);
+			writer.write(~blockSize & 0xffff, 16);
+			out.insert(out.end(), data + offset, data + offset + blockSize);
+		}
+	}
+
+	//a non final block with Huffman codes fitted to the tokens, or stored blocks of the data they encode when these are smaller
+	//like for noisy images, whose literals all end up with about 8 bits codes and then also pay for the codes' description
+	void writeHuffmanBlock(BitWriter &writer, std::vector<uint8_t> &out, const std::vector<Token> &tokens, const uint8_t *data, size_t size)
+	{
+		std::array<uint32_t, literalLengthCount> literalFrequencies = {};
+		std::array<uint32_t, distanceCount> distanceFrequencies = {};
+		for (const Token &token : tokens)
+		{
+			if (token.distance == 0)
+			{
+				literalFrequencies[token.value]++;
+			}
+			else
+			{
+				literalFrequencies[firstLengthCode + lengthCodes[token.value]]++;
+				distanceFrequencies[distanceCode(token.distance)]++;
+			}
+		}
+		literalFrequencies[endOfBlock]++;
+
+		std::array<uint8_t, literalLengthCount> literalLengths;
+		std::array<uint8_t, distanceCount> distanceLengths;
+		buildCodeLengths(literalFrequencies.data(), literalLengthCount, maxCodeLength, literalLengths.data());
+		buildCodeLengths(distanceFrequencies.data(), distanceCount, maxCodeLength, distanceLengths.data());
+		//a block without any match still describes a distance code
+		if (std::all_of(distanceLengths.begin(), distanceLengths.end(), [](uint8_t length) { return length == 0; }))
+		{
+			distanceLengths[0] = 1;
+		}
+
+		std::array<uint16_t, literalLengthCount> literalCodes = {};
+		std::array<uint16_t, distanceCount> distanceCodes = {};
+		buildCodes(literalLengths.data(), literalLengthCount, literalCodes.data());
+		buildCodes(distanceLengths.data(), distanceCount, distanceCodes.data());
+
+		size_t literalCodeCount = literalLengthCount;
+		while (literalLengths[literalCodeCount - 1] == 0) literalCodeCount--;
+		size_t distanceCodeCount = distanceCount;
+		while (distanceCodeCount > 1 && distanceLengths[distanceCodeCount - 1] == 0) distanceCodeCount--;
+
+		//both codes' lengths follow each other, run length encoded with the code length alphabet
+		std::vector<uint8_t> codeLengths(literalLengths.begin(), literalLengths.begin() + literalCodeCount);
+		codeLengths.insert(codeLengths.end(), distanceLengths.begin(), distanceLengths.begin() + distanceCodeCount);
+
+		struct CodeLengthSymbol
+		{
+			uint8_t symbol;
+			uint8_t extraBits;
+		};
+		std::vector<CodeLengthSymbol> codeLengthSymbols;
+		std::array<uint32_t, codeLengthCount> codeLengthFrequencies = {};
+		const auto addSymbol = [&](uint8_t symbol, uint8_t extraBits)
+		{
+			codeLengthSymbols.push_back({ symbol, extraBits });
+			codeLengthFrequencies[symbol]++;
+		};
+		for (size_t i = 0; i < codeLengths.size();)
+		{
+			const uint8_t length = codeLengths[i];
+			size_t run = 1;
+			while (i + run < codeLengths.size() && codeLengths[i + run] == length) run++;
+			i += run;
+
+			if (length == 0)
+			{
+				for (; run >= 11; run -= std::min<size_t>(run, 138))
+				{
+					addSymbol(18, static_cast<uint8_t>(std::min<size_t>(run, 138) - 11));
+				}
+				if (run >= 3)
+				{
+					addSymbol(17, static_cast<uint8_t>(run - 3));
+					run = 0;
+				}
+			}
+			else
+			{
+				addSymbol(length, 0);
+				run--;
+				for (; run >= 3; run -= std::min<size_t>(run, 6))
+				{
+					addSymbol(16, static_cast<uint8_t>(std::min<size_t>(run, 6) - 3));
+				}
+			}
+			for (; run > 0; run--)
+			{
+				addSymbol(length, 0);
+			}
+		}
+
+		std::array<uint8_t, codeLengthCount> codeLengthLengths;
+		std::array<uint16_t, codeLengthCount> codeLengthCodes = {};
+		buildCodeLengths(codeLengthFrequencies.data(), codeLengthCount, maxCodeLengthCodeLength, codeLengthLengths.data());
+		buildCodes(codeLengthLengths.data(), codeLengthCount, codeLengthCodes.data());
+
+		size_t codeLengthCodeCount = codeLengthCount;
+		while (codeLengthCodeCount > 4 && codeLengthLengths[codeLengthOrder[codeLengthCodeCount - 1]] == 0) codeLengthCodeCount--;
+
+		const auto repeatExtraBits = [](uint8_t symbol) -> uint32_t
+		{
+			if (symbol == 16) return 2;
+			if (symbol == 17) return 3;
+			if (symbol == 18) return 7;
+			return 0;
+		};
+
+		//the header, the code lengths then the tokens
+		size_t huffmanBitCount = 3 + 5 + 5 + 4 + 3 * codeLengthCodeCount;
+		for (const CodeLengthSymbol &codeLength : codeLengthSymbols)
+		{
+			huffmanBitCount += codeLengthLengths[codeLength.symbol] + repeatExtraBits(codeLength.symbol);
+		}
+		for (const Token &token : tokens)
+		{
+			if (token.distance == 0)
+			{
+				huffmanBitCount += literalLengths[token.value];
+				continue;
+			}
+
+			const uint8_t lengthCode = lengthCodes[token.value];
+			const uint8_t distance = distanceCode(token.distance);
+			huffmanBitCount += literalLengths[firstLengthCode + lengthCode] + lengthExtraBits[lengthCode] + distanceLengths[distance] + distanceExtraBits[distance];
+		}
+		huffmanBitCount += literalLengths[endOfBlock];
+
+		//each stored block's header, with at most 7 bits of padding, then its bytes
+		const size_t storedBlockCount = std::max<size_t>(1, (size + maxStoredBlockSize - 1) / maxStoredBlockSize);
+		const size_t storedBitCount = storedBlockCount * (3 + 7 + 32) + size * 8;
+		if (storedBitCount <= huffmanBitCount)
+		{
+			writeStoredBlocks(writer, out, data, size);
+			return;
+		}
+
+		//not the final block, the stream ends with an empty one after the last chunk
+		writer.write(0, 1);
+		//dynamic Huffman codes
+		writer.write(2, 2);
+		writer.write(static_cast<uint32_t>(literalCodeCount - firstLengthCode), 5);
+		writer.write(static_cast<uint32_t>(distanceCodeCount - 1), 5);
+		writer.write(static_cast<uint32_t>(codeLengthCodeCount - 4), 4);
+		for (size_t i = 0; i < codeLengthCodeCount; i++)
+		{
+			writer.write(codeLengthLengths[codeLengthOrder[i]], 3);
+		}
+		for (const CodeLengthSymbol &codeLength : codeLengthSymbols)
+		{
+			writer.write(codeLengthCodes[codeLength.symbol], codeLengthLengths[codeLength.symbol]);
+			writer.write(codeLength.extraBits, repeatExtraBits(codeLength.symbol));
+		}
+
+		for (const Token &token : tokens)
+		{
+			if (token.distance == 0)
+			{
+				writer.write(literalCodes[token.value], literalLengths[token.value]);
+				continue;
+			}
+
+			const uint8_t lengthCode = lengthCodes[token.value];
+			writer.write(literalCodes[firstLengthCode + lengthCode], literalLengths[firstLengthCode + lengthCode]);
+			writer.write(token.value - lengthBases[lengthCode], lengthExtraBits[lengthCode]);
+
+			const uint8_t distance = distanceCode(token.distance);
+			writer.write(distanceCodes[distance], distanceLengths[distance]);
+			writer.write(token.distance - distanceBases[distance], distanceExtraBits[distance]);
+		}
+		writer.write(literalCodes[endOfBlock], literalLengths[endOfBlock]);
+	}
+
+	uint8_t paeth(uint8_t left, uint8_t up, uint8_t upLeft)
+	{
+		const int estimate = left + up - upLeft;
+		const int leftDistance = std::abs(estimate - left);
+		const int upDistance = std::abs(estimate - up);
+		const int upLeftDistance = std::abs(estimate - upLeft);
+		if (leftDistance <= upDistance && leftDistance <= upLeftDistance) return left;
+		return upDistance <= upLeftDistance ? up : upLeft;
+	}
+
+	//the file's rows start from the top, and only have an alpha channel when there are 4 channels
+	void loadRow(const png::writeInfo &info, size_t row, size_t channelCount, uint8_t *out)
+	{
+		const size_t y = info.invertedY ? row : info.yPixelCount - 1 - row;
+		const bmp::color *in = info.contents + y * info.xPixelCount;
+		for (size_t x = 0; x < info.xPixelCount; x++, out += channelCount)
+		{
+			out[0] = in[x].r;
+			out[1] = in[x].g;
+			out[2] = in[x].b;
+			if (channelCount == 4) out[3] = in[x].a;
+		}
+	}
+
+	enum Filter : uint8_t
+	{
+		None = 0,
+		Sub = 1,
+		Up = 2,
+		Paeth = 4
+	};
+
+	//appends the filter's type and the row it leaves, picking the filter whose differences are the smallest, which compress the best
+	void filterRow(const uint8_t *row, const uint8_t *previousRow, size_t size, size_t pixelSize, std::vector<uint8_t> &candidate, std::vector<uint8_t> &out)
+	{
+		constexpr std::array<Filter, 3> filters = { Sub, Up, Paeth };
+
+		const size_t start = out.size();
+		out.resize(start + 1 + size);
+		candidate.resize(size);
+		size_t bestSum = SIZE_MAX;
+		for (Filter filter : filters)
+		{
+			size_t sum = 0;
+			for (size_t i = 0; i < size; i++)
+			{
+				const uint8_t left = i >= pixelSize ? row[i - pixelSize] : 0;
+				const uint8_t upLeft = i >= pixelSize ? previousRow[i - pixelSize] : 0;
+				const uint8_t predicted = filter == Sub ? left : filter == Up ? previousRow[i] : paeth(left, previousRow[i], upLeft);
+				candidate[i] = static_cast<uint8_t>(row[i] - predicted);
+				sum += std::abs(static_cast<int8_t>(candidate[i]));
+			}
+
+			if (sum < bestSum)
+			{
+				bestSum = sum;
+				out[start] = filter;
+				std::copy(candidate.begin(), candidate.end(), out.begin() + start + 1);
+			}
+		}
+	}
+
+	struct Chunk
+	{
+		std::vector<uint8_t> compressed;
+		//of the filtered rows, combined afterwards into the whole stream's
+		uint32_t adler = 1;
+		size_t filteredSize = 0;
+		//of the chunk's IDAT
+		uint32_t crc = 0;
+	};
+
+	constexpr char dataChunkType[] = "IDAT";
+
+	//rows [beginRow, endRow) filtered then deflated, ending on a byte boundary for the next chunk to follow
+	void compressChunk(const png::writeInfo &info, size_t channelCount, size_t beginRow, size_t endRow, Chunk &chunk)
+	{
+		const size_t rowSize = size_t(info.xPixelCount) * channelCount;
+		//the row above the image is made of zeros
+		std::vector<uint8_t> previousRow(rowSize, 0), row(rowSize);
+		if (beginRow > 0) loadRow(info, beginRow - 1, channelCount, previousRow.data());
+
+		std::vector<uint8_t> filtered, candidate;
+		filtered.reserve((rowSize + 1) * (endRow - beginRow));
+		for (size_t y = beginRow; y < endRow; y++)
+		{
+			loadRow(info, y, channelCount, row.data());
+			if (info.compression == png::Compression::Stored)
+			{
+				//filtering only helps compression
+				filtered.push_back(None);
+				filtered.insert(filtered.end(), row.begin(), row.end());
+			}
+			else
+			{
+				filterRow(row.data(), previousRow.data(), rowSize, channelCount, candidate, filtered);
+			}
+			std::swap(row, previousRow);
+		}
+		chunk.adler = adler32(filtered.data(), filtered.size());
+		chunk.filteredSize = filtered.size();
+
+		BitWriter writer(chunk.compressed);
+		if (beginRow == 0)
+		{
+			//zlib's header : deflate with a 32KB window, compressed fast
+			chunk.compressed.insert(chunk.compressed.end(), { 0x78, 0x01 });
+		}
+
+		if (info.compression == png::Compression::Stored)
+		{
+			writeStoredBlocks(writer, chunk.compressed, filtered.data(), filtered.size());
+		}
+		else
+		{
+			std::vector<Token> tokens;
+			tokens.reserve(filtered.size() / 2);
+			findMatches(filtered.data(), filtered.size(), tokens);
+			writeHuffmanBlock(writer, chunk.compressed, tokens, filtered.data(), filtered.size());
+
+			//an empty stored block, which aligns the end of the chunk to a byte like zlib's full flush
+			writer.write(0, 3);
+			writer.alignToByte();
+			writer.write(0x0000, 16);
+			writer.write(0xffff, 16);
+		}
+
+		chunk.crc = crc32(chunk.compressed.data(), chunk.compressed.size(), crc32(reinterpret_cast<const uint8_t *>(dataChunkType), 4));
+	}
+
+	void appendBigEndian(std::vector<uint8_t> &out, uint32_t value)
+	{
+		out.insert(out.end(), { static_cast<uint8_t>(value >> 24), static_cast<uint8_t>(value >> 16), static_cast<uint8_t>(value >> 8), static_cast<uint8_t>(value) });
+	}
+
+	void writeFileChunk(std::ofstream &file, const char *type, const uint8_t *data, size_t size, uint32_t crc)
+	{
+		std::vector<uint8_t> length, checksum;
+		appendBigEndian(length, static_cast<uint32_t>(size));
+		appendBigEndian(checksum, crc);
+		file.write(reinterpret_cast<const char *>(length.data()), length.size());
+		file.write(type, 4);
+		file.write(reinterpret_cast<const char *>(data), size);
+		file.write(reinterpret_cast<const char *>(checksum.data()), checksum.size());
+	}
+
+	void writeFileChunk(std::ofstream &file, const char *type, const std::vector<uint8_t> &data)
+	{
+		const uint32_t crc = crc32(data.data(), data.size(), crc32(reinterpret_cast<const uint8_t *>(type), 4));
+		writeFileChunk(file, type, data.data(), data.size(), crc);
+	}
+}
+
+namespace png
+{
+	void write(const writeInfo info)
+	{
+		const size_t pixelCount = size_t(info.xPixelCount) * info.yPixelCount;
+		const bool isOpaque = std::all_of(info.contents, info.contents + pixelCount, [](const bmp::color &color) { return color.a == 0xff; });
+		const size_t channelCount = isOpaque ? 3 : 4;
+
+		const size_t filteredRowSize = info.xPixelCount * channelCount + 1;
+		const size_t rowsPerChunk = std::max<size_t>(1, chunkSize / filteredRowSize);
+		std::vector<Chunk> chunks((info.yPixelCount + rowsPerChunk - 1) / rowsPerChunk);
+		const auto compressChunks = [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				compressChunk(info, channelCount, i * rowsPerChunk, std::min<size_t>((i + 1) * rowsPerChunk, info.yPixelCount), chunks[i]);
+			}
+		};
+		if (info.isParallel)
+		{
+			JobSystem::parallelFor(chunks.size(), 1, compressChunks);
+		}
+		else
+		{
+			compressChunks(0, chunks.size());
+		}
+
+		//the final block, empty with fixed codes, then the checksum of everything that was compressed
+		std::vector<uint8_t> streamEnd = { 0x03, 0x00 };
+		uint32_t adler = 1;
+		for (const Chunk &chunk : chunks)
+		{
+			adler = adler32Combine(adler, chunk.adler, chunk.filteredSize);
+		}
+		appendBigEndian(streamEnd, adler);
+
+		std::vector<uint8_t> header;
+		appendBigEndian(header, info.xPixelCount);
+		appendBigEndian(header, info.yPixelCount);
+		//8 bits per channel, rgb or rgba, then the only compression, filtering and interlacing methods there are
+		header.insert(header.end(), { 8, static_cast<uint8_t>(isOpaque ? 2 : 6), 0, 0, 0 });
+
+		std::ofstream file(info.path, std::ios::binary);
+		if (file.fail()) throw std::runtime_error("File open failed!");
+
+		constexpr uint8_t signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+		file.write(reinterpret_cast<const char *>(signature), sizeof(signature));
+		writeFileChunk(file, "IHDR", header);
+		for (const Chunk &chunk : chunks)
+		{
+			writeFileChunk(file, dataChunkType, chunk.compressed.data(), chunk.compressed.size(), chunk.crc);
+		}
+		writeFileChunk(file, dataChunkType, streamEnd);
+		writeFileChunk(file, "IEND", {});
+
+		if (file.fail()) throw std::runtime_error("File write failed!");
+	}
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include "BMPWriter.h"
+
+#include <cstdint>
+
+//lossless files every viewer reads, with the rows compressed in chunks that are deflated in parallel
+//from : https://www.w3.org/TR/png/ and https://www.rfc-editor.org/rfc/rfc1951
+namespace png
+{
+	enum class Compression
+	{
+		//deflate's uncompressed blocks, when writing fast matters more than the file's size
+		Stored,
+		//filtered rows, greedy matches and a Huffman code fitted to each chunk
+		Fast
+	};
+
+	struct writeInfo
+	{
+		const char *path{};
+		uint32_t xPixelCount{};
+		uint32_t yPixelCount{};
+		const bmp::color *contents{};
+		//the contents start from the top row, rather than from the bottom one like bitmaps
+		bool invertedY = false;
+		Compression compression = Compression::Fast;
+		//compresses the chunks on the job system's workers rather than one after the other on the calling thread
+		bool isParallel = true;
+	};
+
+	//the alpha channel is only written when a pixel isn't opaque
+	//throws when the file can't be written
+	void write(const writeInfo info);
+}
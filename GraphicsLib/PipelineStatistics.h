@@ -0,0 +1,58 @@
+#pragma once
+#include <cstdint>
+
+//counters are compiled in by defining PIPELINE_STATISTICS_ENABLED to 1, draws otherwise leave them untouched
+#ifndef PIPELINE_STATISTICS_ENABLED
+#define PIPELINE_STATISTICS_ENABLED 0
+#endif
+
+namespace gl
+{
+	constexpr bool pipelineStatisticsEnabled = PIPELINE_STATISTICS_ENABLED != 0;
+
+	//what the stages of draws went through, like a GPU's pipeline statistics query
+	//every triangle of a draw that isn't culled as a whole is counted once, either as culled for some reason or as rasterized
+	struct PipelineStatistics
+	{
+		uint64_t verticesShaded = 0;
+		//skipped along with their meshlet, outside of the clip volume or facing away
+		uint64_t meshletCulledTriangles = 0;
+		//outside of the screen, or with a vertex past the guard band
+		uint64_t offscreenTriangles = 0;
+		uint64_t backfacingTriangles = 0;
+		//without any area, or covering no sample point
+		uint64_t degenerateTriangles = 0;
+		uint64_t rasterizedTriangles = 0;
+
+		//samples inside of a triangle, whether they are then depth tested or not
+		uint64_t samplesTested = 0;
+		uint64_t depthTestPasses = 0;
+		uint64_t depthTestFails = 0;
+		//helper lanes of quads aren't shaded, visibility passes shade their fragments when resolved
+		uint64_t fragmentShaderInvocations = 0;
+
+		PipelineStatistics &operator+=(const PipelineStatistics &other)
+		{
+			verticesShaded += other.verticesShaded;
+			meshletCulledTriangles += other.meshletCulledTriangles;
+			offscreenTriangles += other.offscreenTriangles;
+			backfacingTriangles += other.backfacingTriangles;
+			degenerateTriangles += other.degenerateTriangles;
+			rasterizedTriangles += other.rasterizedTriangles;
+			samplesTested += other.samplesTested;
+			depthTestPasses += other.depthTestPasses;
+			depthTestFails += other.depthTestFails;
+			fragmentShaderInvocations += other.fragmentShaderInvocations;
+			return *this;
+		}
+
+		//stages count in a local copy per job, this compiles out with the statistics
+		static void count(uint64_t &counter, uint64_t amount = 1)
+		{
+			if constexpr (pipelineStatisticsEnabled)
+			{
+				counter += amount;
+			}
+		}
+	};
+}
@@ -0,0 +1,246 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <stdexcept>
+#include <string_view>
+
+namespace
+{
+	std::mutex zonesMutex;
+
+	//fields are atomic for the trace to be read while the thread overwrites its oldest zones
+	struct TraceEvent
+	{
+		std::atomic<const char *> name = nullptr;
+		//in nanoseconds since the program started
+		std::atomic<int64_t> start = 0;
+		std::atomic<int64_t> end = 0;
+	};
+
+	//only written to by its thread, kept after it exits for its zones to still be written
+	struct ThreadTrace
+	{
+		std::string name;
+		std::atomic<size_t> writtenEvents = 0;
+		std::unique_ptr<TraceEvent[]> events = std::make_unique<TraceEvent[]>(Profiler::traceSize);
+	};
+
+	//threads are only added the first time they trace
+	std::mutex tracesMutex;
+
+	std::vector<std::unique_ptr<ThreadTrace>> &threadTraces()
+	{
+		static std::vector<std::unique_ptr<ThreadTrace>> instance;
+		return instance;
+	}
+
+	ThreadTrace &ownTrace()
+	{
+		thread_local ThreadTrace *own = nullptr;
+		if (own == nullptr)
+		{
+			std::lock_guard lock(tracesMutex);
+			own = threadTraces().emplace_back(std::make_unique<ThreadTrace>()).get();
+		}
+		return *own;
+	}
+
+	const Profiler::Clock::time_point traceEpoch = Profiler::Clock::now();
+
+	int64_t traceTime(Profiler::Clock::time_point time)
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(time - traceEpoch).count();
+	}
+
+	void writeString(std::FILE *file, std::string_view string)
+	{
+		std::fputc('"', file);
+		for (const char c : string)
+		{
+			if (c == '"' || c == '\\') std::fputc('\\', file);
+			if (static_cast<unsigned char>(c) >= ' ') std::fputc(c, file);
+		}
+		std::fputc('"', file);
+	}
+}
+
+//a few zones, entered a few times a frame : a lock and a linear search cost less than the clock reads around them
+std::vector<Profiler::Zone> &Profiler::zones()
+{
+	static std::vector<Profiler::Zone> instance;
+	return instance;
+}
+
+void Profiler::record(const char *name, std::chrono::nanoseconds duration)
+{
+	std::lock_guard lock(zonesMutex);
+	Zone &zone = findZone(name);
+	zone.frameTime += duration;
+	zone.frameCalls++;
+}
+
+void Profiler::endFrame()
+{
+	std::lock_guard lock(zonesMutex);
+	for (Zone &zone : zones())
+	{
+		//zones that weren't entered don't count the frame, their stats are over the frames they ran in
+		if (zone.frameCalls == 0) continue;
+
+		zone.times[zone.nextFrame] = zone.frameTime;
+		zone.calls[zone.nextFrame] = zone.frameCalls;
+		zone.nextFrame = (zone.nextFrame + 1) % historySize;
+		zone.frameCount = std::min(zone.frameCount + 1, historySize);
+		zone.frameTime = {};
+		zone.frameCalls = 0;
+	}
+}
+
+std::vector<Profiler::ZoneStats> Profiler::stats()
+{
+	std::lock_guard lock(zonesMutex);
+
+	std::vector<ZoneStats> result;
+	for (const Zone &zone : zones())
+	{
+		if (zone.frameCount == 0) continue;
+
+		std::vector<std::chrono::nanoseconds> times(zone.times.begin(), zone.times.begin() + zone.frameCount);
+		const size_t totalCalls = std::accumulate(zone.calls.begin(), zone.calls.begin() + zone.frameCount, size_t(0));
+		const std::chrono::nanoseconds total = std::accumulate(times.begin(), times.end(), std::chrono::nanoseconds(0));
+		const size_t lastFrame = (zone.nextFrame + historySize - 1) % historySize;
+
+		ZoneStats stats =
+		{
+			.name = zone.name,
+			.frameCount = zone.frameCount,
+			.min = *std::min_element(times.begin(), times.end()),
+			.average = total / zone.frameCount,
+			.last = zone.times[lastFrame],
+			.averageCalls = static_cast<float>(totalCalls) / static_cast<float>(zone.frameCount)
+		};
+
+		//the time 99% of the frames took at most
+		const size_t p99Index = (times.size() * 99 + 99) / 100 - 1;
+		std::nth_element(times.begin(), times.begin() + p99Index, times.end());
+		stats.p99 = times[p99Index];
+
+		result.push_back(stats);
+	}
+	return result;
+}
+
+void Profiler::reset()
+{
+	std::lock_guard lock(zonesMutex);
+	zones().clear();
+}
+
+Profiler::Zone &Profiler::findZone(const char *name)
+{
+	std::vector<Zone> &allZones = zones();
+	//the same literal can have different addresses in different translation units
+	const auto found = std::find_if(allZones.begin(), allZones.end(), [name](const Zone &zone)
+	{
+		return zone.name == name || std::string_view(zone.name) == name;
+	});
+	if (found != allZones.end()) return *found;
+
+	allZones.push_back({ .name = name });
+	return allZones.back();
+}
+
+void Profiler::setTracing(bool isEnabled)
+{
+	tracing.store(isEnabled, std::memory_order_relaxed);
+}
+
+void Profiler::trace(const char *name, Clock::time_point start, Clock::time_point end)
+{
+	ThreadTrace &trace = ownTrace();
+	const size_t index = trace.writtenEvents.load(std::memory_order_relaxed);
+	TraceEvent &event = trace.events[index % traceSize];
+	event.name.store(name, std::memory_order_relaxed);
+	event.start.store(traceTime(start), std::memory_order_relaxed);
+	event.end.store(traceTime(end), std::memory_order_relaxed);
+	trace.writtenEvents.store(index + 1, std::memory_order_release);
+}
+
+void Profiler::nameThread(std::string name)
+{
+	ThreadTrace &trace = ownTrace();
+	std::lock_guard lock(tracesMutex);
+	trace.name = std::move(name);
+}
+
+void Profiler::writeTrace(const char *path)
+{
+	std::FILE *file = std::fopen(path, "wb");
+	if (file == nullptr) throw std::runtime_error("File open failed!");
+
+	std::lock_guard lock(tracesMutex);
+	std::fputs("{\"traceEvents\":[\n", file);
+	bool isFirst = true;
+	const auto separate = [&isFirst, file]()
+	{
+		if (!isFirst) std::fputs(",\n", file);
+		isFirst = false;
+	};
+
+	const std::vector<std::unique_ptr<ThreadTrace>> &traces = threadTraces();
+	struct CopiedEvent
+	{
+		const char *name;
+		int64_t start;
+		int64_t end;
+	};
+	std::vector<CopiedEvent> events(traceSize);
+	for (size_t threadId = 0; threadId < traces.size(); threadId++)
+	{
+		const ThreadTrace &trace = *traces[threadId];
+		if (!trace.name.empty())
+		{
+			separate();
+			std::fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%zu,\"args\":{\"name\":", threadId);
+			writeString(file, trace.name);
+			std::fputs("}}", file);
+		}
+
+		//copied first, the zones the thread overwrote meanwhile are then dropped
+		const size_t end = trace.writtenEvents.load(std::memory_order_acquire);
+		const size_t begin = end > traceSize ? end - traceSize : 0;
+		for (size_t i = begin; i < end; i++)
+		{
+			const TraceEvent &event = trace.events[i % traceSize];
+			events[i - begin] =
+			{
+				.name = event.name.load(std::memory_order_relaxed),
+				.start = event.start.load(std::memory_order_relaxed),
+				.end = event.end.load(std::memory_order_relaxed)
+			};
+		}
+		std::atomic_thread_fence(std::memory_order_acquire);
+		//the zone being written when we checked can be in any of the slots past the last whole one
+		const size_t overwritten = trace.writtenEvents.load(std::memory_order_relaxed) + 1;
+		const size_t firstIntact = std::max(begin, overwritten > traceSize ? overwritten - traceSize : 0);
+
+		for (size_t i = firstIntact; i < end; i++)
+		{
+			const CopiedEvent &event = events[i - begin];
+			separate();
+			std::fputs("{\"name\":", file);
+			writeString(file, event.name);
+			//in microseconds
+			std::fprintf(file, ",\"ph\":\"X\",\"pid\":0,\"tid\":%zu,\"ts\":%.3f,\"dur\":%.3f}", threadId, static_cast<double>(event.start) / 1000.0, static_cast<double>(event.end - event.start) / 1000.0);
+		}
+	}
+	std::fputs("\n]}\n", file);
+
+	const bool isWritten = std::ferror(file) == 0;
+	if (std::fclose(file) != 0 || !isWritten) throw std::runtime_error("File write failed!");
+}
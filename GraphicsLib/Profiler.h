@@ -0,0 +1,155 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+//zones are compiled out by defining PROFILER_ENABLED to 0, the profiler then has nothing to report
+#ifndef PROFILER_ENABLED
+#define PROFILER_ENABLED 1
+#endif
+
+//times named zones of code, from any thread, and keeps how long each of them took over the last frames
+//a zone entered several times in a frame, or on several threads at once, adds all of these times up
+//while tracing, zones are also kept one by one per thread, to see where they ran and what they waited on
+class Profiler
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	//how many frames zones keep the times of
+	static constexpr size_t historySize = 256;
+	//how many zones each thread keeps for the trace, the oldest being overwritten first
+	static constexpr size_t traceSize = size_t(1) << 16;
+
+	struct ZoneStats
+	{
+		const char *name = nullptr;
+		//of the kept frames, the ones the zone was entered in, which the times are over
+		size_t frameCount = 0;
+		std::chrono::nanoseconds min = {};
+		std::chrono::nanoseconds average = {};
+		std::chrono::nanoseconds p99 = {};
+		std::chrono::nanoseconds last = {};
+		//entries per frame, on average
+		float averageCalls = .0f;
+	};
+
+	//adds to the zone's time in the current frame, the name has to outlive the profiler, as literals do
+	static void record(const char *name, std::chrono::nanoseconds duration);
+
+	//the times recorded since the last call become the zones' newest frame
+	//passes overlapping two frames record to the one that is open when they finish
+	static void endFrame();
+
+	//zones in the order they were first entered
+	[[nodiscard]]
+	static std::vector<ZoneStats> stats();
+
+	static void reset();
+
+	static void setTracing(bool isEnabled);
+
+	[[nodiscard]]
+	static bool isTracing()
+	{
+		return tracing.load(std::memory_order_relaxed);
+	}
+
+	//adds a zone to the calling thread's trace, without taking any lock
+	static void trace(const char *name, Clock::time_point start, Clock::time_point end);
+
+	//how the calling thread is shown in traces, rather than by a number
+	static void nameThread(std::string name);
+
+	//writes the zones the threads kept, as Chrome's trace event JSON that chrome://tracing and Perfetto open
+	//threads can keep tracing meanwhile, throws when the file can't be written
+	static void writeTrace(const char *path);
+
+private:
+	Profiler() = delete;
+
+	static inline std::atomic<bool> tracing = false;
+
+	struct Zone
+	{
+		const char *name = nullptr;
+		std::chrono::nanoseconds frameTime = {};
+		size_t frameCalls = 0;
+		//the oldest frame is overwritten first
+		std::array<std::chrono::nanoseconds, historySize> times = {};
+		std::array<size_t, historySize> calls = {};
+		size_t frameCount = 0;
+		size_t nextFrame = 0;
+	};
+
+	static std::vector<Zone> &zones();
+	static Zone &findZone(const char *name);
+};
+
+//records the time between its construction and destruction
+class ProfileZone
+{
+public:
+	explicit ProfileZone(const char *name) : name(name), start(Profiler::Clock::now()) {}
+
+	~ProfileZone()
+	{
+		const Profiler::Clock::time_point end = Profiler::Clock::now();
+		Profiler::record(name, end - start);
+		if (Profiler::isTracing())
+		{
+			Profiler::trace(name, start, end);
+		}
+	}
+
+	ProfileZone(const ProfileZone &) = delete;
+	ProfileZone &operator=(const ProfileZone &) = delete;
+
+private:
+	const char *name;
+	Profiler::Clock::time_point start;
+};
+
+//only traced, for zones entered too often to go through the profiler's lock, like tiles and jobs
+//the clock isn't even read when not tracing
+class TraceZone
+{
+public:
+	explicit TraceZone(const char *name) : name(Profiler::isTracing() ? name : nullptr)
+	{
+		if (this->name != nullptr)
+		{
+			start = Profiler::Clock::now();
+		}
+	}
+
+	~TraceZone()
+	{
+		if (name != nullptr)
+		{
+			Profiler::trace(name, start, Profiler::Clock::now());
+		}
+	}
+
+	TraceZone(const TraceZone &) = delete;
+	TraceZone &operator=(const TraceZone &) = delete;
+
+private:
+	const char *name;
+	Profiler::Clock::time_point start;
+};
+
+#if PROFILER_ENABLED
+#define PROFILER_CONCATENATE_DETAIL(a, b) a##b
+#define PROFILER_CONCATENATE(a, b) PROFILER_CONCATENATE_DETAIL(a, b)
+//times the rest of the enclosing scope
+#define PROFILE_ZONE(name) const ProfileZone PROFILER_CONCATENATE(profileZone, __LINE__)(name)
+//traces the rest of the enclosing scope
+#define TRACE_ZONE(name) const TraceZone PROFILER_CONCATENATE(traceZone, __LINE__)(name)
+#else
+#define PROFILE_ZONE(name) do {} while (false)
+#define TRACE_ZONE(name) do {} while (false)
+#endif
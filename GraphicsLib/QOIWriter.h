@@ -0,0 +1,153 @@
+#pragma once
+#include "BMPWriter.h"
+
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+//"Quite OK Image" files : lossless, encoded in a single pass, a few times smaller than bitmaps for rendered images
+//from : https://qoiformat.org/qoi-specification.pdf
+namespace qoi
+{
+	struct writeInfo
+	{
+		const char *path{};
+		uint32_t xPixelCount{};
+		uint32_t yPixelCount{};
+		const bmp::color *contents{};
+		//the contents start from the top row, rather than from the bottom one like bitmaps
+		bool invertedY = false;
+	};
+
+	namespace details
+	{
+		constexpr uint8_t opIndex = 0x00;
+		constexpr uint8_t opDiff = 0x40;
+		constexpr uint8_t opLuma = 0x80;
+		constexpr uint8_t opRun = 0xc0;
+		constexpr uint8_t opRGB = 0xfe;
+		constexpr uint8_t opRGBA = 0xff;
+		constexpr uint8_t maxRun = 62;
+
+		struct Pixel
+		{
+			uint8_t r = 0, g = 0, b = 0, a = 0;
+
+			bool operator==(const Pixel &) const = default;
+		};
+
+		inline void appendBigEndian(std::vector<uint8_t> &out, uint32_t value)
+		{
+			out.push_back(static_cast<uint8_t>(value >> 24));
+			out.push_back(static_cast<uint8_t>(value >> 16));
+			out.push_back(static_cast<uint8_t>(value >> 8));
+			out.push_back(static_cast<uint8_t>(value));
+		}
+
+		inline size_t hash(const Pixel &pixel)
+		{
+			return (pixel.r * 3 + pixel.g * 5 + pixel.b * 7 + pixel.a * 11) % 64;
+		}
+	}
+
+	//the whole file, as it would be written
+	inline std::vector<uint8_t> encode(const writeInfo &info)
+	{
+		using namespace details;
+
+		std::vector<uint8_t> out;
+		//a full color operation per pixel at worst
+		out.reserve(14 + size_t(info.xPixelCount) * info.yPixelCount * 5 + 8);
+
+		constexpr char magic[] = "qoif";
+		out.insert(out.end(), magic, magic + 4);
+		appendBigEndian(out, info.xPixelCount);
+		appendBigEndian(out, info.yPixelCount);
+		//4 channels, sRGB with linear alpha
+		out.push_back(4);
+		out.push_back(0);
+
+		std::array<Pixel, 64> seenPixels = {};
+		Pixel previous = { .a = 0xff };
+		uint8_t run = 0;
+		for (uint32_t row = 0; row < info.yPixelCount; row++)
+		{
+			//files start from the top row
+			const uint32_t y = info.invertedY ? row : info.yPixelCount - 1 - row;
+			const bmp::color *in = info.contents + size_t(y) * info.xPixelCount;
+			for (uint32_t x = 0; x < info.xPixelCount; x++)
+			{
+				const Pixel pixel = { in[x].r, in[x].g, in[x].b, in[x].a };
+				if (pixel == previous)
+				{
+					if (++run == maxRun)
+					{
+						out.push_back(static_cast<uint8_t>(opRun | (run - 1)));
+						run = 0;
+					}
+					continue;
+				}
+
+				if (run > 0)
+				{
+					out.push_back(static_cast<uint8_t>(opRun | (run - 1)));
+					run = 0;
+				}
+
+				const size_t index = hash(pixel);
+				if (seenPixels[index] == pixel)
+				{
+					out.push_back(static_cast<uint8_t>(opIndex | index));
+				}
+				else
+				{
+					seenPixels[index] = pixel;
+					if (pixel.a == previous.a)
+					{
+						//differences wrap around, as the decoder's sums do
+						const int8_t dr = static_cast<int8_t>(pixel.r - previous.r);
+						const int8_t dg = static_cast<int8_t>(pixel.g - previous.g);
+						const int8_t db = static_cast<int8_t>(pixel.b - previous.b);
+						const int drg = dr - dg;
+						const int dbg = db - dg;
+						if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+						{
+							out.push_back(static_cast<uint8_t>(opDiff | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2)));
+						}
+						else if (dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7)
+						{
+							out.push_back(static_cast<uint8_t>(opLuma | (dg + 32)));
+							out.push_back(static_cast<uint8_t>((drg + 8) << 4 | (dbg + 8)));
+						}
+						else
+						{
+							out.insert(out.end(), { opRGB, pixel.r, pixel.g, pixel.b });
+						}
+					}
+					else
+					{
+						out.insert(out.end(), { opRGBA, pixel.r, pixel.g, pixel.b, pixel.a });
+					}
+				}
+				previous = pixel;
+			}
+		}
+		if (run > 0) out.push_back(static_cast<uint8_t>(opRun | (run - 1)));
+
+		constexpr uint8_t endMarker[] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+		out.insert(out.end(), endMarker, endMarker + sizeof(endMarker));
+		return out;
+	}
+
+	inline void write(const writeInfo info)
+	{
+		const std::vector<uint8_t> contents = encode(info);
+
+		std::ofstream file(info.path, std::ios::binary);
+		if (file.fail()) throw std::runtime_error("File open failed!");
+		file.write(reinterpret_cast<const char *>(contents.data()), contents.size());
+		if (file.fail()) throw std::runtime_error("File write failed!");
+	}
+}
@@ -1,6 +1,7 @@
 #pragma once
 #include "CommonConcepts.h"
 #include <cmath>
+#include <array>
 
 namespace sampling
 {
@@ -10,6 +11,36 @@ namespace sampling
 		Bilinear
 	};
 
+	//how depth comparisons are filtered, each tap but the nearest one comparing the 2x2 texels around it like hardware PCF
+	enum class CompareFilter
+	{
+		Nearest,
+		Bilinear,
+		//taps one texel apart
+		Grid3x3,
+		Grid5x5,
+		//taps spread over a disk of CompareSampler::poissonRadius texels
+		Poisson16
+	};
+
+	struct CompareSampler
+	{
+		CompareFilter filter = CompareFilter::Bilinear;
+		float poissonRadius = 2.0f;
+		//moves the reference towards what the buffer was rendered from before comparing, so that surfaces don't shadow themselves
+		//in the unit of the compared values
+		float depthBias = .0f;
+	};
+
+	//points of the unit disk that are evenly spread without being regular, which would show as banding
+	inline constexpr std::array<std::array<float, 2>, 16> poissonDisk =
+	{ {
+		{ -.94201624f, -.39906216f }, { .94558609f, -.76890725f }, { -.09418410f, -.92938870f }, { .34495938f, .29387760f },
+		{ -.91588581f, .45771432f }, { -.81544232f, -.87912464f }, { -.38277543f, .27676845f }, { .97484398f, .75648379f },
+		{ .44323325f, -.97511554f }, { .53742981f, -.47373420f }, { -.26496911f, -.41893023f }, { .79197514f, .19090188f },
+		{ -.24188840f, .99706507f }, { -.81409955f, .91437590f }, { .19984126f, .78641367f }, { .14383161f, -.14100790f }
+	} };
+
 	template<typename T, con::InvocableWith<int, int> SampleTexelT>
 	[[nodiscard]]
 	T bilinear(float u, float v, ivec2 dimensions, SampleTexelT sample)
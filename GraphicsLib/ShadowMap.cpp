@@ -0,0 +1,185 @@
+#include "ShadowMap.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+
+namespace
+{
+	struct NoAttributes
+	{
+		static NoAttributes barycentricInterpolation(Triangle::BarycentricCoordinates, NoAttributes, NoAttributes, NoAttributes)
+		{
+			return {};
+		}
+	};
+
+	//further than anything the far plane can hold
+	constexpr float clearDepth = 1000000000.0f;
+	constexpr size_t rowsPerConversionJob = 32;
+
+	//orthographic transform looking along -towardsLight, covering the sphere and casterDistance further towards the light
+	//depth grows away from the light like with the shadow maps' usual transforms, whose handedness it keeps
+	mat4x4 fitLightViewProjection(const vec3 &center, float radius, const vec3 &towardsLight, float casterDistance)
+	{
+		const vec3 up = std::abs(towardsLight.y()) < .99f ? vec3(.0f, 1.0f, .0f) : vec3(1.0f, .0f, .0f);
+		const vec3 right = vec3::cross(up, towardsLight).normalized();
+		const vec3 lightUp = vec3::cross(towardsLight, right);
+
+		const float nearDistance = radius + casterDistance;
+		const float depthScale = -2.0f / (nearDistance + radius);
+		const float depthOffset = (nearDistance - radius) / (nearDistance + radius);
+		return mat4x4({
+			right.x() / radius, right.y() / radius, right.z() / radius, -vec3::dot(center, right) / radius,
+			lightUp.x() / radius, lightUp.y() / radius, lightUp.z() / radius, -vec3::dot(center, lightUp) / radius,
+			towardsLight.x() * depthScale, towardsLight.y() * depthScale, towardsLight.z() * depthScale, -vec3::dot(center, towardsLight) * depthScale + depthOffset,
+			.0f, .0f, .0f, 1.0f
+			});
+	}
+}
+
+namespace gl
+{
+	ShadowMap::ShadowMap(const CreateInfo &info) :
+		width(info.width),
+		height(info.height),
+		format(info.format),
+		depth({ .width = format == DepthFormat::Float32 ? info.width : 0, .height = format == DepthFormat::Float32 ? info.height : 0, .clearValue = clearDepth }),
+		unormDepth({ .width = format == DepthFormat::Unorm16 ? info.width : 0, .height = format == DepthFormat::Unorm16 ? info.height : 0, .clearValue = encodeUnorm16Depth(clearDepth) })
+	{
+	}
+
+	mat4x4 ShadowMap::snapToTexels(const mat4x4 &lightViewProjection) const
+	{
+		//where the world's origin lands, in texels, the projection being orthographic
+		const vec4 origin = lightViewProjection * vec4(.0f, .0f, .0f, 1.0f);
+		const float halfWidth = static_cast<float>(width) * .5f;
+		const float halfHeight = static_cast<float>(height) * .5f;
+		const float texelX = origin.x() * halfWidth;
+		const float texelY = origin.y() * halfHeight;
+
+		const vec3 offset = vec3((std::round(texelX) - texelX) / halfWidth, (std::round(texelY) - texelY) / halfHeight, .0f);
+		return mat4x4::translate(offset) * lightViewProjection;
+	}
+
+	void ShadowMap::render(const mat4x4 &lightViewProjection, std::span<const ShadowCaster> casters)
+	{
+		snappedLightViewProjection = snapToTexels(lightViewProjection);
+
+		auto drawCasters = [this, casters](auto &target)
+		{
+			target.clear();
+			for (const ShadowCaster &caster : casters)
+			{
+				const mat4x4 modelViewProjection = snappedLightViewProjection * caster.transform;
+				auto vertexShader = [&modelViewProjection](Triangle::Vertex vertex) -> VertexReturn<NoAttributes>
+				{
+					vertex.position = modelViewProjection * vertex.position;
+					return { vertex, {} };
+				};
+
+				auto drawInfo = makeDepthOnlyDrawInfo<NoAttributes>(target, vertexShader);
+				drawInfo.modelViewProjection = modelViewProjection;
+				Rasterizer::drawTriangles(caster.model, drawInfo);
+			}
+		};
+
+		if (format == DepthFormat::Unorm16)
+		{
+			drawCasters(unormDepth);
+		}
+		else
+		{
+			drawCasters(depth);
+		}
+	}
+
+	void ShadowMap::copyDepth(FrameBuffer<float> &destination) const
+	{
+		assert(destination.width == width && destination.height == height && destination.sampleCount == 1);
+
+		JobSystem::parallelFor(height, rowsPerConversionJob, [this, &destination](size_t beginRow, size_t endRow)
+		{
+			for (size_t y = beginRow; y < endRow; y++)
+			for (size_t x = 0; x < width; x++)
+			{
+				destination.atTexel(x, y) = depthAt(x, y);
+			}
+		});
+	}
+
+	CascadedShadowMap::CascadedShadowMap(const CreateInfo &info) :
+		borderSize(borderTexels * 2.0f / static_cast<float>(info.resolution)),
+		splitBlend(info.splitBlend),
+		casterDistance(info.casterDistance)
+	{
+		for (size_t i = 0; i < info.cascadeCount; i++)
+		{
+			cascades.push_back(std::make_unique<ShadowMap>(ShadowMap::CreateInfo{ .width = info.resolution, .height = info.resolution, .format = info.format }));
+		}
+	}
+
+	void CascadedShadowMap::render(const mat4x4 &cameraViewProjection, float cameraNear, float cameraFar, const vec3 &towardsLight, std::span<const ShadowCaster> casters)
+	{
+		//corners of the near and far planes, a slice of the frustum lies between points of the same edges
+		const mat4x4 clipToWorld = cameraViewProjection.inversed();
+		std::array<vec3, 4> nearCorners = {}, farCorners = {};
+		for (size_t i = 0; i < 4; i++)
+		{
+			const float x = i % 2 == 0 ? -1.0f : 1.0f;
+			const float y = i / 2 == 0 ? -1.0f : 1.0f;
+			const vec4 nearCorner = clipToWorld * vec4(x, y, -1.0f, 1.0f);
+			const vec4 farCorner = clipToWorld * vec4(x, y, 1.0f, 1.0f);
+			nearCorners[i] = nearCorner.xyz() / nearCorner.w();
+			farCorners[i] = farCorner.xyz() / farCorner.w();
+		}
+
+		//between the camera's planes, how far along each edge the slices start
+		auto splitFraction = [&](size_t split)
+		{
+			const float fraction = static_cast<float>(split) / static_cast<float>(cascades.size());
+			const float uniform = cameraNear + (cameraFar - cameraNear) * fraction;
+			const float logarithmic = cameraNear * std::pow(cameraFar / cameraNear, fraction);
+			return (std::lerp(uniform, logarithmic, splitBlend) - cameraNear) / (cameraFar - cameraNear);
+		};
+
+		const vec3 lightDirection = towardsLight.normalized();
+		JobCounter counter;
+		for (size_t i = 0; i < cascades.size(); i++)
+		{
+			std::array<vec3, 8> corners = {};
+			const float sliceNear = splitFraction(i);
+			const float sliceFar = splitFraction(i + 1);
+			for (size_t corner = 0; corner < 4; corner++)
+			{
+				const vec3 edge = farCorners[corner] - nearCorners[corner];
+				corners[corner] = nearCorners[corner] + edge * sliceNear;
+				corners[corner + 4] = nearCorners[corner] + edge * sliceFar;
+			}
+
+			//a sphere keeps the same size whatever the camera's orientation, so its texels do too and snapping keeps the edges still
+			vec3 center = vec3(.0f, .0f, .0f);
+			for (const vec3 &corner : corners)
+			{
+				center += corner / static_cast<float>(corners.size());
+			}
+			float radius = .0f;
+			for (const vec3 &corner : corners)
+			{
+				radius = std::max(radius, (corner - center).length());
+			}
+			//rounded up so that float error doesn't change it from one frame to the next
+			radius = std::ceil(radius * 16.0f) / 16.0f;
+
+			const mat4x4 lightViewProjection = fitLightViewProjection(center, radius, lightDirection, casterDistance);
+			ShadowMap &cascade = *cascades[i];
+			JobSystem::run([&cascade, lightViewProjection, casters]()
+			{
+				cascade.render(lightViewProjection, casters);
+			}, &counter);
+		}
+		JobSystem::wait(counter);
+	}
+}
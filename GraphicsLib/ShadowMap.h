@@ -0,0 +1,180 @@
+#pragma once
+#include "GraphicsLibrary.h"
+#include "Framebuffer.h"
+#include "mat.h"
+#include "vec.h"
+#include "Sampling.h"
+
+#include <memory>
+#include <span>
+#include <vector>
+#include <cstdint>
+
+namespace gl
+{
+	enum class DepthFormat
+	{
+		//half the memory and bandwidth of Float32, both when rendering and sampling, enough precision for most light ranges
+		Unorm16,
+		Float32
+	};
+
+	struct ShadowCaster
+	{
+		ModelHandle model;
+		//model to world space
+		mat4x4 transform = mat4x4::identity();
+	};
+
+	//depth of the scene as seen from a directional light, with its own resolution whatever the target's is
+	//depths are in normalized device coordinates, from -1 on the near plane to 1 on the far one
+	class ShadowMap
+	{
+	public:
+
+		struct CreateInfo
+		{
+			size_t width = 0;
+			size_t height = 0;
+			DepthFormat format = DepthFormat::Float32;
+		};
+
+		explicit ShadowMap(const CreateInfo &info);
+
+		ShadowMap(const ShadowMap &) = delete;
+		ShadowMap &operator=(const ShadowMap &) = delete;
+
+		//moves the light's world to clip space transform by less than a texel, so that world space lines up with whole texels
+		//the shadows' edges then don't shimmer as the light's frustum follows the camera
+		[[nodiscard]]
+		mat4x4 snapToTexels(const mat4x4 &lightViewProjection) const;
+
+		//clears the map and draws the casters' depth only, through the texel snapped version of the light's transform
+		void render(const mat4x4 &lightViewProjection, std::span<const ShadowCaster> casters);
+
+		//world to clip space transform the map was last rendered with, to find the light space positions it is sampled at
+		[[nodiscard]]
+		const mat4x4 &lightViewProjection() const
+		{
+			return snappedLightViewProjection;
+		}
+
+		//1 when the light clip space position is lit, 0 when it's behind what the map holds, in between along filtered shadow edges
+		//positions outside of the map are lit, the sampler's bias is in normalized device depth whatever the map's format
+		[[nodiscard]]
+		float compare(const vec4 &lightClipPosition, const sampling::CompareSampler &sampler = {}) const
+		{
+			const vec3 projected = lightClipPosition.xyz() / lightClipPosition.w();
+			const float u = projected.x() * .5f + .5f;
+			const float v = projected.y() * .5f + .5f;
+			//also rejects NaNs
+			if (!(u >= .0f && v >= .0f && u < 1.0f && v < 1.0f)) return 1.0f;
+
+			if (format == DepthFormat::Unorm16)
+			{
+				//rounded like the depths the map holds, a surface then finds its own depth rather than up to half a step in front of it
+				sampling::CompareSampler unormSampler = sampler;
+				unormSampler.depthBias *= 65535.0f * .5f;
+				return unormDepth.sampleCompare(u, v, static_cast<float>(encodeUnorm16Depth(projected.z())), unormSampler);
+			}
+			return depth.sampleCompare(u, v, projected.z(), sampler);
+		}
+
+		[[nodiscard]]
+		float depthAt(size_t x, size_t y) const
+		{
+			if (format == DepthFormat::Unorm16)
+			{
+				return decodeUnorm16Depth(unormDepth.atTexel(x, y));
+			}
+			return depth.atTexel(x, y);
+		}
+
+		[[nodiscard]]
+		DepthFormat depthFormat() const
+		{
+			return format;
+		}
+
+		//decodes the map's depths, to look at them whatever its format
+		void copyDepth(FrameBuffer<float> &destination) const;
+
+		const size_t width, height;
+
+	private:
+
+		DepthFormat format;
+		//the casters are drawn straight into the map of the chosen format, the other one being left empty
+		FrameBuffer<float> depth;
+		FrameBuffer<uint16_t> unormDepth;
+		mat4x4 snappedLightViewProjection = mat4x4::identity();
+	};
+
+	//shadow maps covering consecutive slices of the camera's frustum, each fitted around its slice
+	//near slices are smaller, so the texels close to the camera cover less of the scene
+	class CascadedShadowMap
+	{
+	public:
+
+		struct CreateInfo
+		{
+			//of each cascade
+			size_t resolution = 1024;
+			DepthFormat format = DepthFormat::Float32;
+			size_t cascadeCount = 4;
+			//0 splits the frustum in slices of the same depth, 1 in slices growing as far as they are from the camera
+			float splitBlend = .75f;
+			//how far behind a slice, towards the light, casters can be
+			float casterDistance = 5.0f;
+		};
+
+		explicit CascadedShadowMap(const CreateInfo &info);
+
+		CascadedShadowMap(const CascadedShadowMap &) = delete;
+		CascadedShadowMap &operator=(const CascadedShadowMap &) = delete;
+
+		//fits the cascades to the frustum of the camera's world to clip space transform, cameraNear and cameraFar being its planes' distances
+		//then renders them at the same time, each as its own job
+		void render(const mat4x4 &cameraViewProjection, float cameraNear, float cameraFar, const vec3 &towardsLight, std::span<const ShadowCaster> casters);
+
+		//compares in the first cascade covering the world space position, lit when none does
+		[[nodiscard]]
+		float compare(const vec3 &worldPosition, const sampling::CompareSampler &sampler = {}) const
+		{
+			const vec4 position = vec4::fromPoint(worldPosition);
+			for (const std::unique_ptr<ShadowMap> &cascade : cascades)
+			{
+				const vec4 lightClipPosition = cascade->lightViewProjection() * position;
+				//the filters read a few texels around the position, which have to be within the cascade too
+				if (std::abs(lightClipPosition.x()) < 1.0f - borderSize && std::abs(lightClipPosition.y()) < 1.0f - borderSize)
+				{
+					return cascade->compare(lightClipPosition, sampler);
+				}
+			}
+			return 1.0f;
+		}
+
+		[[nodiscard]]
+		const ShadowMap &cascade(size_t index) const
+		{
+			return *cascades[index];
+		}
+
+		[[nodiscard]]
+		size_t cascadeCount() const
+		{
+			return cascades.size();
+		}
+
+	private:
+
+		//in texels
+		static constexpr float borderTexels = 3.0f;
+
+		std::vector<std::unique_ptr<ShadowMap>> cascades;
+		//in normalized device coordinates
+		float borderSize;
+		float splitBlend;
+		float casterDistance;
+	};
+}
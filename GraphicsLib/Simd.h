@@ -0,0 +1,7 @@
+#pragma once
+
+//what the vectorized paths build on, every x64 processor has SSE2 so it's used whenever the target allows it
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SIMD_SSE2 1
+#include <emmintrin.h>
+#endif
@@ -12,6 +12,19 @@ struct Triangle
 	struct BarycentricCoordinates
 	{
 		friend struct Triangle;
+
+		//for weights found some other way, such as the rasterizer's edge functions, weighted by the vertices' w like calculate2DBarycentricCoords
+		[[nodiscard]]
+		static BarycentricCoordinates fromWeights(const vec3 &weights, const std::array<float, 3> &vertexWs) noexcept
+		{
+			auto coordinates = BarycentricCoordinates(weights.x(), weights.y(), weights.z());
+			for (int i = 0; i < 3; i++)
+			{
+				if (vertexWs[i] >= .0001f) coordinates.coordinates[i] /= vertexWs[i];
+			}
+			return coordinates;
+		}
+
 		bool areDegenerate() const
 		{
 			for (size_t i = 0; i < 3; i++)
@@ -0,0 +1,149 @@
+#include "VideoStream.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <csignal>
+#include <sys/stat.h>
+#endif
+
+namespace
+{
+	constexpr size_t rowsPerConversionJob = 32;
+}
+
+namespace gl
+{
+	VideoStream::VideoStream(const CreateInfo &info) :
+		width(info.width),
+		height(info.height),
+		format(info.format),
+		encoding(info.encoding),
+		frameBytes(info.width * info.height * 3)
+	{
+		if (std::strcmp(info.path, "-") == 0)
+		{
+			file = stdout;
+#ifdef _WIN32
+			//newlines would otherwise be written as \r\n
+			_setmode(_fileno(stdout), _O_BINARY);
+#endif
+		}
+		else
+		{
+#ifdef _MSC_VER
+			if (fopen_s(&file, info.path, "wb") != 0) file = nullptr;
+#else
+			file = std::fopen(info.path, "wb");
+#endif
+			if (file == nullptr) throw std::runtime_error("File open failed!");
+			ownsFile = true;
+		}
+
+#ifndef _WIN32
+		//the encoder stopping would otherwise kill the process with the next frame
+		struct stat fileStatus = {};
+		isPipe = fstat(fileno(file), &fileStatus) == 0 && S_ISFIFO(fileStatus.st_mode);
+		if (isPipe)
+		{
+			previousPipeHandler = std::signal(SIGPIPE, SIG_IGN);
+		}
+#endif
+
+		if (format == Format::Y4M)
+		{
+			const std::string header = "YUV4MPEG2 W" + std::to_string(width) + " H" + std::to_string(height) +
+				" F" + std::to_string(info.framesPerSecond) + ":1 Ip A1:1 C444\n";
+			if (!writeBytes(header.data(), header.size())) hasFailed.store(true, std::memory_order_release);
+		}
+	}
+
+	VideoStream::~VideoStream()
+	{
+		if (ownsFile)
+		{
+			std::fclose(file);
+		}
+		else
+		{
+			std::fflush(file);
+		}
+
+#ifndef _WIN32
+		if (isPipe && previousPipeHandler != SIG_ERR)
+		{
+			std::signal(SIGPIPE, previousPipeHandler);
+		}
+#endif
+	}
+
+	void VideoStream::write(const FrameBuffer<vec4> &frame)
+	{
+		assert(frame.width == width && frame.height == height && frame.sampleCount == 1);
+		if (isBroken()) return;
+
+		bool isWritten = true;
+		if (format == Format::RawRGB)
+		{
+			//framebuffers start from the bottom row, videos from the top one
+			ColorConversion::convert(frame.data, width, height, frameBytes.data(), { .order = ColorConversion::ChannelOrder::RGB, .encoding = encoding, .isTopDown = true });
+		}
+		else
+		{
+			convertToYUV(frame);
+
+			constexpr char frameHeader[] = "FRAME\n";
+			isWritten = writeBytes(frameHeader, sizeof(frameHeader) - 1);
+		}
+
+		if (!isWritten || !writeBytes(frameBytes.data(), frameBytes.size()))
+		{
+			hasFailed.store(true, std::memory_order_release);
+			return;
+		}
+		writtenFrames.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void VideoStream::convertToYUV(const FrameBuffer<vec4> &frame)
+	{
+		const size_t planeSize = width * height;
+		//sRGB channels go through the same table as 8 bit outputs, the matrix then applying to the encoded values
+		const auto channel = [this](float value)
+		{
+			if (encoding == ColorConversion::Encoding::Linear) return std::clamp(value, .0f, 1.0f);
+			return static_cast<float>(ColorConversion::encodeChannel(value, encoding)) / 255.0f;
+		};
+		JobSystem::parallelFor(height, rowsPerConversionJob, [&](size_t beginRow, size_t endRow)
+		{
+			for (size_t row = beginRow; row < endRow; row++)
+			{
+				const size_t y = height - 1 - row;
+				for (size_t x = 0; x < width; x++)
+				{
+					const vec4 &color = frame.atTexel(x, y);
+					const size_t pixel = row * width + x;
+					//BT.601 in studio range, what players assume when the stream doesn't say
+					const float r = channel(color.r());
+					const float g = channel(color.g());
+					const float b = channel(color.b());
+					frameBytes[pixel] = static_cast<uint8_t>(16.5f + 65.481f * r + 128.553f * g + 24.966f * b);
+					frameBytes[planeSize + pixel] = static_cast<uint8_t>(128.5f - 37.797f * r - 74.203f * g + 112.0f * b);
+					frameBytes[2 * planeSize + pixel] = static_cast<uint8_t>(128.5f + 112.0f * r - 93.786f * g - 18.214f * b);
+				}
+			}
+		});
+	}
+
+	bool VideoStream::writeBytes(const void *bytes, size_t size)
+	{
+		return std::fwrite(bytes, 1, size, file) == size;
+	}
+}
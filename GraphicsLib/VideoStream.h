@@ -0,0 +1,88 @@
+#pragma once
+#include "Framebuffer.h"
+#include "ColorConversion.h"
+#include "vec.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdint>
+#include <vector>
+
+namespace gl
+{
+	//writes consecutive frames to a file or the standard output, for an encoder process to read them
+	//everything a frame is converted to is allocated once, when the stream is opened
+	class VideoStream
+	{
+	public:
+
+		enum class Format
+		{
+			//8 bits per channel, top row first, without any header
+			RawRGB,
+			//YUV4MPEG2 with full resolution chroma, which encoders such as ffmpeg read as is
+			Y4M
+		};
+
+		struct CreateInfo
+		{
+			//"-" for the standard output
+			const char *path = "-";
+			size_t width = 0;
+			size_t height = 0;
+			Format format = Format::Y4M;
+			uint32_t framesPerSecond = 60;
+			//how the frames' colors are encoded before being converted to the format, players expecting sRGB
+			ColorConversion::Encoding encoding = ColorConversion::Encoding::Linear;
+		};
+
+		//throws when the file can't be opened
+		//writing to a pipe whose reader is gone fails rather than raising SIGPIPE, for as long as the stream is open
+		explicit VideoStream(const CreateInfo &info);
+		~VideoStream();
+
+		VideoStream(const VideoStream &) = delete;
+		VideoStream &operator=(const VideoStream &) = delete;
+
+		//the frame has to be of the stream's size, single sampled and within [0, 1]
+		//writes run in jobs, which have no one to throw to : failing breaks the stream instead, later frames being ignored
+		void write(const FrameBuffer<vec4> &frame);
+
+		//both can be checked from any thread, while a job is writing
+		[[nodiscard]]
+		size_t frameCount() const
+		{
+			return writtenFrames.load(std::memory_order_relaxed);
+		}
+
+		//whether a write failed, such as when the reading end of a pipe was closed
+		[[nodiscard]]
+		bool isBroken() const
+		{
+			return hasFailed.load(std::memory_order_acquire);
+		}
+
+	private:
+
+		//planar, top row first
+		void convertToYUV(const FrameBuffer<vec4> &frame);
+		//returns whether every byte was written
+		[[nodiscard]]
+		bool writeBytes(const void *bytes, size_t size);
+
+		size_t width, height;
+		Format format;
+		ColorConversion::Encoding encoding;
+		std::FILE *file = nullptr;
+		bool ownsFile = false;
+		std::atomic<size_t> writtenFrames = 0;
+		std::atomic<bool> hasFailed = false;
+#ifndef _WIN32
+		//the SIGPIPE handler to put back, when writing to a pipe
+		void (*previousPipeHandler)(int) = nullptr;
+		bool isPipe = false;
+#endif
+		//a whole converted frame, written at once
+		std::vector<uint8_t> frameBytes;
+	};
+}
@@ -8,7 +8,11 @@
 #include "CoreLoop.h"
 #include "Triangle.h"
 #include "GraphicsLibrary.h"
-#include "BMPWriter.h"
+#include "FrameGraph.h"
+#include "ShadowMap.h"
+#include "ExportQueue.h"
+#include "VideoStream.h"
+#include "Profiler.h"
 
 #include <utility>
 #include <limits>
@@ -16,28 +20,77 @@
 #include <span>
 #include <algorithm>
 #include <iostream>
+#include <array>
+#include <optional>
 
 constexpr size_t width = 500u, height = 500u;
-
-gl::FrameBuffer<vec4> colorImage = gl::FrameBuffer<vec4>({
+constexpr uint32_t sampleCount = 4u;
+//the color pass first only finds what's visible, then shades each texel once instead of every fragment passing the depth test
+//worth it when there's a lot of overdraw or the fragment shader is expensive, the vertices of visible triangles being shaded again
+constexpr bool useVisibilityBuffer = false;
+//independent from the output's, 16 bits of depth being plenty for the light's range
+constexpr size_t shadowMapResolution = 1024u;
+//the view frustum is split in this many slices, each with a shadow map of the resolution above
+constexpr size_t shadowCascadeCount = 3u;
+constexpr gl::DepthFormat shadowMapFormat = gl::DepthFormat::Unorm16;
+//softens the shadows' edges, Grid and Poisson filters blur them further for more comparisons per fragment
+//the bias, a few steps of a 16 bit map, keeps lit surfaces from shadowing themselves where their depth is rounded or interpolated
+constexpr sampling::CompareSampler shadowSampler = { .filter = sampling::CompareFilter::Bilinear, .depthBias = .0002f };
+//shading is done in linear light, what is looked at, the window, the video and the color screenshot, is sRGB encoded
+constexpr gl::ColorConversion::Encoding outputEncoding = gl::ColorConversion::Encoding::SRGB;
+//when set, every frame is also streamed there as Y4M for an encoder to read, "-" being the standard output
+constexpr const char *videoStreamPath = nullptr;
+//when set, the zones of the last frames are traced and written there as Chrome trace JSON when T is pressed
+constexpr const char *tracePath = "trace.json";
+
+gl::FrameBuffer<vec4> multisampledColorImage = gl::FrameBuffer<vec4>({
 	.width = width,
 	.height = height,
-	.clearValue = {.0f,.0f,.0f,1.0f}
+	.clearValue = {.0f,.0f,.0f,1.0f},
+	.sampleCount = sampleCount
 	});
 
+//the multisampled image is resolved to one of these, one is presented while the other is resolved to
+gl::FrameBuffer<vec4> colorImages[2] = 
+{
+	gl::FrameBuffer<vec4>({
+		.width = width,
+		.height = height,
+		.clearValue = {.0f,.0f,.0f,1.0f}
+		}),
+	gl::FrameBuffer<vec4>({
+		.width = width,
+		.height = height,
+		.clearValue = {.0f,.0f,.0f,1.0f}
+		})
+};
+
 gl::FrameBuffer<float> depthImage = gl::FrameBuffer<float>({
 	.width = width,
 	.height = height,
-	.clearValue = 1000000000.0f
+	.clearValue = 1000000000.0f,
+	.sampleCount = sampleCount
 	});
 
-gl::FrameBuffer<float> shadowMap = gl::FrameBuffer<float>({
-	.width = width,
-	.height = height,
-	.clearValue = 1000000000.0f
+gl::FrameBuffer<gl::VisibilitySample> visibilityImage = gl::FrameBuffer<gl::VisibilitySample>({
+	.width = useVisibilityBuffer ? width : 0,
+	.height = useVisibilityBuffer ? height : 0,
+	.sampleCount = sampleCount
 	});
 
-const gl::ModelHandle handle = gl::Rasterizer::uploadModel(ModelLoader::loadModel("assets/head.obj"));
+gl::CascadedShadowMap shadowMap = gl::CascadedShadowMap({
+	.resolution = shadowMapResolution,
+	.format = shadowMapFormat,
+	.cascadeCount = shadowCascadeCount
+	});
+
+//the color pass's counters over the last frame it drew, left at zero unless PIPELINE_STATISTICS_ENABLED is defined to 1
+gl::PipelineStatistics colorPassStatistics;
+
+//files the screenshot pass has the images exported to
+const std::array<const char *, 3> screenshotPaths = { "shadowmap.png", "color.png", "depth.png" };
+
+const gl::ModelHandle handle = gl::Rasterizer::uploadModel(ModelLoader::loadModel("assets/head.obj"), { .optimize = true });
 
 const Image texture = Image("assets/head_diffuse.png");
 
@@ -72,176 +125,188 @@ MVP getMVP(const Time& time)
 	};
 }
 
-MVP getShadowMapMVP(const Time &time)
-{
-	return
-	{
-		.model = mat3x3::rotatedY(time.asSeconds()).expandTo<4>(),
-		.view = mat4x4::lookAt({
-			.eye = lightDirection * -2.0f, 
-			.target = vec3(), 
-			.up = vec3(.0f,1.0f,.0f)}),
-		.projection = mat4x4::orthographic({
-			.right = 1,
-			.left = -1,
-			.top = 1,
-			.bottom = -1,
-			.far = zFar,
-			.near = zNear})
-	};
-}
-
-struct ShadowPassAttributes
-{
-	static ShadowPassAttributes barycentricInterpolation(Triangle::BarycentricCoordinates, ShadowPassAttributes, ShadowPassAttributes, ShadowPassAttributes)
-	{
-		return {};
-	}
-};
-
 void shadowMapPass(const Time &time)
 {
-	shadowMap.clear();
-	depthImage.clear();
-
-	MVP mvp = getShadowMapMVP(time);
-
-	auto vertexShader = [&mvp](Triangle::Vertex vertex) -> gl::VertexReturn<ShadowPassAttributes>
-	{
-		vertex.position = mvp.calculate() * vertex.position;
-		return { vertex };
-	};
-
-	auto fragmentShader = [](const Triangle::Vertex &v, ShadowPassAttributes)
-	{
-		return v.position.z();
-	};
-
-	auto drawInfo = gl::makeDrawInfo<float, ShadowPassAttributes>(shadowMap, vertexShader, fragmentShader, &depthImage);
-
-	gl::Rasterizer::drawTriangles(handle, drawInfo);
+	const MVP mvp = getMVP(time);
+	const gl::ShadowCaster caster = { .model = handle, .transform = mvp.model };
+	shadowMap.render(mvp.projection * mvp.view, zNear, zFar, lightDirection, std::span(&caster, 1));
 }
 
 struct ColorPassAttributes
 {
-	vec4 lightSpacePosition;
+	//the cascade a fragment is compared in depends on where it is
+	vec4 worldPosition;
 	static ColorPassAttributes barycentricInterpolation(Triangle::BarycentricCoordinates coords, ColorPassAttributes a, ColorPassAttributes b, ColorPassAttributes c)
 	{
-		return { coords.weigh(a.lightSpacePosition, b.lightSpacePosition, c.lightSpacePosition) };
+		return { coords.weigh(a.worldPosition, b.worldPosition, c.worldPosition) };
 	}
 };
 
 void colorPass(const Time& time)
 {
-	colorImage.clear();
+	multisampledColorImage.clear();
 	depthImage.clear();
 
 	const MVP mvp = getMVP(time);
-	const MVP shadowMapMVP = getShadowMapMVP(time);
 
-	auto vertexShader = [&mvp, &shadowMapMVP](Triangle::Vertex vertex) -> gl::VertexReturn<ColorPassAttributes>
+	auto vertexShader = [&mvp](Triangle::Vertex vertex) -> gl::VertexReturn<ColorPassAttributes>
 	{
 		const vec4 normal = vec4::fromDirection(vertex.normal);
 		const vec4 offset = normal * .01f;
-		const vec4 lightSpacePosition = shadowMapMVP.calculate() * (vertex.position + offset);
+		const vec4 worldPosition = mvp.model * (vertex.position + offset);
 
 		vertex.normal = (mvp.model.inversed().transposed() * normal).xyz();
 		vertex.position = mvp.calculate() * vertex.position;
 
-		return { vertex, { lightSpacePosition } };
+		return { vertex, { worldPosition } };
 	};
 
 	auto fragmentShader = [&](const Triangle::Vertex &vertex, ColorPassAttributes attributes)
 	{
-		const vec3 textureCol = texture.atUV(vertex.u, vertex.v);
+		//the texture is stored sRGB encoded, squaring it is close enough to decoding it for a diffuse color
+		const vec3 encodedTextureCol = texture.atUV(vertex.u, vertex.v);
+		const vec3 textureCol = encodedTextureCol * encodedTextureCol;
 		const vec3 normal = vertex.normal.normalized();
 
 		const float lambertian = vec3::dot(normal, lightDirection);
 		const vec3 col = (textureCol * vertex.color * lambertian).saturate();
 
-		const vec3 lightSpaceProjected = (attributes.lightSpacePosition.xyz() / attributes.lightSpacePosition.w()) * vec3(.5f, .5f, 1.0f) + vec3(.5f, .5f, .0f);
-
-		const float lightSpaceDepth = shadowMap.atUV(lightSpaceProjected.x(), lightSpaceProjected.y(), sampling::SamplerMode::Nearest);
-		const float currentLightSpaceDepth = lightSpaceProjected.z();
-		const float shadow = currentLightSpaceDepth < lightSpaceDepth ? 1.0f : 0.4f;
+		const float shadow = .4f + .6f * shadowMap.compare(attributes.worldPosition.xyz(), shadowSampler);
 
 		return vec4::fromPoint(col*shadow);
 	};
 
-	auto drawInfo = gl::makeDrawInfo<vec4, ColorPassAttributes>(colorImage, vertexShader, fragmentShader, &depthImage);
-
-	gl::Rasterizer::drawTriangles(handle, drawInfo);
-}
+	colorPassStatistics = {};
+	auto drawInfo = gl::makeDrawInfo<vec4, ColorPassAttributes>(multisampledColorImage, vertexShader, fragmentShader, &depthImage);
+	drawInfo.modelViewProjection = mvp.calculate();
+	drawInfo.statistics = &colorPassStatistics;
 
-void writeToBMP(std::span<float> span, const char* name)
-{
-	std::vector<bmp::color> spanAsColors(span.size());
-	for (size_t i = 0; i < spanAsColors.size(); i++)
+	if constexpr (useVisibilityBuffer)
 	{
-		const float in = span[i];
-		const unsigned char value = static_cast<unsigned char>(255.9f * in);
-		spanAsColors[i] = bmp::color{ value, value , value, 0xff };
-	}
-
-	const bmp::writeInfo writeInfo =
-	{
-		.path = name,
-		.xPixelCount = width,
-		.yPixelCount = height,
-		.contents = spanAsColors.data()
-	};
-	bmp::write(writeInfo);
-}
+		visibilityImage.clear();
 
-void writeToBMP(std::span<vec4> span, const char *name)
-{
-	std::vector<bmp::color> spanAsColors(span.size());	
+		auto visibilityDrawInfo = gl::makeVisibilityDrawInfo<ColorPassAttributes>(visibilityImage, vertexShader, &depthImage);
+		visibilityDrawInfo.modelViewProjection = mvp.calculate();
+		visibilityDrawInfo.statistics = &colorPassStatistics;
 
-	for(size_t i = 0; i < spanAsColors.size(); i++)
-	{
-		constexpr float toByte = 255.9f;
-		const vec4 in = span[i];
-		spanAsColors[i] = bmp::color{ (uint8_t)(in.b() * toByte), (uint8_t)(in.g() * toByte) , (uint8_t)(in.r() * toByte), 0xff };
+		gl::Rasterizer::drawTriangles(handle, visibilityDrawInfo);
+		gl::Rasterizer::shadeVisibility(handle, visibilityImage, drawInfo);
 	}
-
-	const bmp::writeInfo writeInfo =
+	else
 	{
-		.path = name,
-		.xPixelCount = width,
-		.yPixelCount = height,
-		.contents = spanAsColors.data()
-	};
-	bmp::write(writeInfo);
+		gl::Rasterizer::drawTriangles(handle, drawInfo);
+	}
 }
 
 int main()
 {
+	Profiler::nameThread("main");
+	Profiler::setTracing(tracePath != nullptr);
+
 	RenderToWindow window(width, height, "color");
+	//outlives the frame graph, whose screenshot passes submit to it
+	gl::ExportQueue exportQueue;
+	std::optional<gl::VideoStream> videoStream;
+	if (videoStreamPath != nullptr)
+	{
+		videoStream.emplace(gl::VideoStream::CreateInfo{ .path = videoStreamPath, .width = width, .height = height, .encoding = outputEncoding });
+	}
+	gl::FrameGraph frameGraph;
+	size_t frameIndex = 0;
 
 	CoreLoop::run([&](const Time &time, const Input &input)
 	{
 		const bool screenshot = input[input::VirtualKeys::Space] == input::InputState::Pressed;
+		if (tracePath != nullptr && input[input::VirtualKeys::T] == input::InputState::Pressed)
+		{
+			Profiler::writeTrace(tracePath);
+		}
+		gl::FrameBuffer<vec4> &colorImage = colorImages[frameIndex % 2];
+		frameIndex++;
 
-		shadowMapPass(time);
+		frameGraph.addPass("shadow map", {}, { &shadowMap }, [time]()
+		{
+			shadowMapPass(time);
+		});
 
-		if(screenshot)
+		frameGraph.addPass("color", { &shadowMap }, { &multisampledColorImage, &depthImage, &visibilityImage }, [time]()
 		{
-			const std::span<float> shadowmapData = std::span<float>(shadowMap.data, shadowMap.height * shadowMap.width);
-			writeToBMP(shadowmapData, "shadowmap.bmp");
-		}
+			colorPass(time);
+		});
 
-		colorPass(time);
+		frameGraph.addPass("resolve", { &multisampledColorImage }, { &colorImage }, [&colorImage]()
+		{
+			multisampledColorImage.resolve(colorImage);
+		});
+
+		//the encoder may have stopped reading, the stream is then left alone
+		if (videoStream.has_value() && !videoStream->isBroken())
+		{
+			frameGraph.addPass("video", { &colorImage }, { &videoStream }, [&videoStream, &colorImage]()
+			{
+				videoStream->write(colorImage);
+			});
+		}
 
 		if(screenshot)
 		{
-			const std::span<vec4> colorImageData = std::span<vec4>(colorImage.data, colorImage.height * colorImage.width);
-			writeToBMP(colorImageData, "color.bmp");
-			const std::span<float> depthImageData = std::span<float>(depthImage.data, depthImage.height * depthImage.width);
-			writeToBMP(depthImageData, "depth.bmp");
+			//the images are only copied here, they're converted and written on the export queue's thread
+			//passes run on the workers, which mustn't wait for the queue : images are dropped while it's full
+			//the queue is what the pass writes to, so that the screenshots of successive frames are submitted in order
+			frameGraph.addPass("screenshot", { &shadowMap, &colorImage, &depthImage }, { &exportQueue }, [&colorImage, &exportQueue]()
+			{
+				gl::FrameBuffer<float> shadowMapImage = gl::FrameBuffer<float>({ .width = shadowMapResolution, .height = shadowMapResolution });
+				shadowMap.cascade(0).copyDepth(shadowMapImage);
+				exportQueue.trySubmit(shadowMapImage, screenshotPaths[0]);
+				exportQueue.trySubmit(colorImage, screenshotPaths[1], outputEncoding);
+				gl::FrameBuffer<float> resolvedDepthImage = gl::FrameBuffer<float>({ .width = width, .height = height });
+				depthImage.resolve(resolvedDepthImage);
+				exportQueue.trySubmit(resolvedDepthImage, screenshotPaths[2]);
+			});
 		}
 
-		window.updateImage(colorImage.data);
+		//overlaps with the next frame's rendering, which goes to the other color image
+		frameGraph.addPass("present", { &colorImage }, { &window }, [&window, &colorImage]()
+		{
+			window.updateImage(colorImage.data, outputEncoding);
+		});
+
+		frameGraph.submitFrame();
+		//passes still running from this frame are recorded to the next one
+		Profiler::endFrame();
 	});
 
+	frameGraph.waitIdle();
+	exportQueue.flush();
+
+	//diagnostics go to the standard error, the standard output can be carrying the video stream
+	const gl::ExportQueue::Stats exportStats = exportQueue.stats();
+	if (exportStats.stalledSubmissions > 0 || exportStats.failedFrames > 0 || exportStats.droppedFrames > 0)
+	{
+		std::cerr << "exported " << exportStats.writtenFrames << " images, " << exportStats.failedFrames << " failed, "
+			<< exportStats.droppedFrames << " dropped with the queue full, " << exportStats.stalledSubmissions << " submissions waited "
+			<< std::chrono::duration_cast<std::chrono::milliseconds>(exportStats.stallTime).count() << "ms for the export queue\n";
+	}
+
+	if constexpr (gl::pipelineStatisticsEnabled)
+	{
+		const gl::PipelineStatistics &statistics = colorPassStatistics;
+		std::cerr << "color pass : " << statistics.verticesShaded << " vertices shaded, " << statistics.rasterizedTriangles << " triangles rasterized, "
+			<< statistics.meshletCulledTriangles << " culled with their meshlet, " << statistics.backfacingTriangles << " backfacing, "
+			<< statistics.offscreenTriangles << " offscreen, " << statistics.degenerateTriangles << " degenerate, "
+			<< statistics.samplesTested << " samples tested, " << statistics.depthTestPasses << " passed the depth test, " << statistics.depthTestFails << " failed it, "
+			<< statistics.fragmentShaderInvocations << " fragments shaded\n";
+	}
+
+	const auto toMilliseconds = [](std::chrono::nanoseconds duration)
+	{
+		return std::chrono::duration<float, std::milli>(duration).count();
+	};
+	for (const Profiler::ZoneStats &zone : Profiler::stats())
+	{
+		std::cerr << zone.name << " : " << toMilliseconds(zone.min) << "ms min, " << toMilliseconds(zone.average) << "ms average, "
+			<< toMilliseconds(zone.p99) << "ms p99 over " << zone.frameCount << " frames, " << zone.averageCalls << " calls per frame\n";
+	}
+
 	return 0;
 }
\ No newline at end of file
@@ -1,3 +1,3 @@
 #include "Time.h"
 
-const Time Time::startTime = Time::milliseconds_since_epoch();
\ No newline at end of file
+const Time::clock::time_point Time::startTime = Time::clock::now();
\ No newline at end of file
@@ -10,7 +10,15 @@ public:
 		long long amount = 0;
 	};
 
+	//monotonic, unlike the system's clock which jumps when it is set
+	using clock = std::chrono::steady_clock;
+
 	Time(milliseconds originalAmount = { 0 })
+	{
+		ticks = std::chrono::milliseconds(originalAmount.amount);
+	}
+
+	explicit Time(std::chrono::nanoseconds originalAmount)
 	{
 		ticks = originalAmount;
 	}
@@ -29,17 +37,25 @@ public:
 		return ((float)milliseconds_since_epoch().amount) / 1000.0f;
 	}
 
+	//since the program started
 	static Time now()
 	{
-		return Time({ milliseconds_since_epoch().amount }) - startTime;
+		return Time(std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - startTime));
 	}
 
 	float asSeconds() const
 	{
-		return ((float)asMilliseconds().amount) / 1000.0f;
+		//in double first, floats can't hold nanoseconds counts past a few seconds
+		return (float)std::chrono::duration<double>(ticks).count();
 	}
 
 	milliseconds asMilliseconds() const
+	{
+		return { std::chrono::duration_cast<std::chrono::milliseconds>(ticks).count() };
+	}
+
+	[[nodiscard]]
+	std::chrono::nanoseconds asNanoseconds() const
 	{
 		return ticks;
 	}
@@ -47,40 +63,42 @@ public:
 	[[nodiscard]]
 	Time operator-(const Time &other) const
 	{
-		return Time({ ticks.amount - other.ticks.amount });
+		return Time(ticks - other.ticks);
 	}
 
 	void operator-=(const Time &other)
 	{
-		ticks.amount -= other.ticks.amount;
+		ticks -= other.ticks;
 	}
 
 	void operator+=(const Time &other)
 	{
-		ticks.amount += other.ticks.amount;
+		ticks += other.ticks;
 	}
 
+	//in milliseconds
 	void operator-=(float other)
 	{
-		ticks.amount -= (long long)other;
+		ticks -= std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::duration<float, std::milli>(other));
 	}
 
+	//in milliseconds
 	void operator+=(float other)
 	{
-		ticks.amount += (long long)other;
+		ticks += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::duration<float, std::milli>(other));
 	}
 
 	[[nodiscard]]
 	Time operator+(const Time &other) const
 	{
-		return Time({ ticks.amount + other.ticks.amount });
+		return Time(ticks + other.ticks);
 	}
 
-	static const Time startTime;
+	static const clock::time_point startTime;
 
 private:
 
-	milliseconds ticks = {};
+	std::chrono::nanoseconds ticks = {};
 };
 
 #endif
\ No newline at end of file